@@ -0,0 +1,130 @@
+// Benchmarks of the segmentor hot paths across input length and ambiguity.
+//
+// Usage: epinyin_bench [--benchmark_format=json] [--benchmark_out=<file>]
+// Run it where syllable_list.csv is, like epinyin_test.
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "syllable_segmentation.hpp"
+
+namespace {
+
+using namespace epinyin;
+
+// Inputs repeat one of these, from few segmentations to one per syllable
+// boundary choice.
+const char* const kAmbiguityPatterns[] = {"zhuang", "fangan", "xian"};
+
+const std::shared_ptr<SyllableIndex>& Index()
+{
+  static const auto index = SyllableIndex::CreateShared("syllable_list.csv");
+  return index;
+}
+
+std::string MakeInput(const benchmark::State& state)
+{
+  const std::string pattern = kAmbiguityPatterns[state.range(1)];
+  std::string input;
+  const auto length = static_cast<size_t>(state.range(0));
+  while (input.size() < length) {
+    input += pattern;
+  }
+  input.resize(length);
+  return input;
+}
+
+// Lengths are multiples of every pattern length, so every input segments.
+void LengthAndAmbiguity(benchmark::internal::Benchmark* b)
+{
+  b->ArgNames({"phones", "ambiguity"});
+  const int64_t num_patterns = std::size(kAmbiguityPatterns);
+  for (int64_t ambiguity = 0; ambiguity < num_patterns; ++ambiguity) {
+    for (int64_t phones : {12, 24, 48}) {
+      b->Args({phones, ambiguity});
+    }
+  }
+}
+
+// Types the whole input one keystroke at a time.
+void BM_AppendPhone(benchmark::State& state)
+{
+  const auto input = MakeInput(state);
+  SyllableSegmentor segmentor(Index());
+  for (auto _ : state) {
+    segmentor.Clear();
+    for (auto phone : input) {
+      segmentor.AppendPhone(phone);
+    }
+    benchmark::DoNotOptimize(segmentor.CountSegmentations());
+  }
+  state.SetItemsProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_AppendPhone)->Apply(LengthAndAmbiguity);
+
+// Deletes the whole input one backspace at a time.
+void BM_PopLastPhone(benchmark::State& state)
+{
+  const auto input = MakeInput(state);
+  SyllableSegmentor segmentor(Index());
+  for (auto _ : state) {
+    state.PauseTiming();
+    segmentor.Clear();
+    segmentor.AppendPhones(input);
+    state.ResumeTiming();
+    while (segmentor.size() > 0) {
+      segmentor.PopLastPhone();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_PopLastPhone)->Apply(LengthAndAmbiguity);
+
+// Renders every segmentation by depth-first enumeration.
+void BM_GetSyllableList(benchmark::State& state)
+{
+  SyllableSegmentor segmentor(Index());
+  segmentor.AppendPhones(MakeInput(state));
+  size_t results = 0;
+  for (auto _ : state) {
+    auto page = segmentor.GetSyllableList(SyllableSegmentor::EnumerationOptions());
+    results = page.syllable_lists_.size();
+    benchmark::DoNotOptimize(page);
+  }
+  state.counters["results"] = results;
+  state.SetItemsProcessed(state.iterations() * results);
+}
+BENCHMARK(BM_GetSyllableList)->Apply(LengthAndAmbiguity);
+
+// A keystroke as an input method makes it: replace the last phone, then ask
+// for every segmentation, which reuses the cached prefixes.
+void BM_KeystrokeWithCachedList(benchmark::State& state)
+{
+  const auto input = MakeInput(state);
+  SyllableSegmentor segmentor(Index());
+  segmentor.AppendPhones(input);
+  for (auto _ : state) {
+    segmentor.PopLastPhone();
+    segmentor.AppendPhone(input.back());
+    benchmark::DoNotOptimize(segmentor.GetSyllableList());
+  }
+}
+BENCHMARK(BM_KeystrokeWithCachedList)->Apply(LengthAndAmbiguity);
+
+// Looks every syllable up in the index.
+void BM_GetIndex(benchmark::State& state)
+{
+  const auto& index = *Index();
+  for (auto _ : state) {
+    for (int16_t i = 0; i < index.size(); ++i) {
+      benchmark::DoNotOptimize(index.GetIndex(index.SyllableAt(i)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * index.size());
+}
+BENCHMARK(BM_GetIndex);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,24 @@
+// Compiles the syllable dict file into a binary index file which
+// SyllableIndex::OpenMapped() serves lookups from without parsing.
+//
+// Usage: epinyin_compile_index syllable_list.csv syllable_index.bin
+
+#include <iostream>
+
+#include "syllable_segmentation.hpp"
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <syllable_list.csv> <output.bin>"
+              << std::endl;
+    return 1;
+  }
+  try {
+    epinyin::SyllableIndex(argv[1]).Save(argv[2]);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,146 @@
+// Generates inputs for stress testing and benchmarking the segmentor, one
+// input per line, so the files can be replayed by epinyin_replay.
+//
+// worst: for every length up to <max_length>, the input found with the most
+//   segmentations. The lengths and counts are printed to stderr as well.
+// sentences: <count> inputs of syllables drawn by their frequency.
+//
+// Usage: epinyin_gen_corpus syllable_list.csv worst <max_length> <output.txt>
+//        epinyin_gen_corpus syllable_list.csv sentences <count> <output.txt>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#include "syllable_segmentation.hpp"
+
+namespace {
+
+using namespace epinyin;
+
+// Inputs kept per length while searching for the worst ones.
+const size_t kBeamWidth = 16;
+const int kMinSentenceSyllables = 2;
+const int kMaxSentenceSyllables = 12;
+const uint32_t kSentenceSeed = 42;
+
+typedef std::pair<uint64_t, std::string> Candidate;
+
+/*
+ * Beam search by length: the inputs kept for a length are extended by every
+ * syllable, and each length keeps the kBeamWidth extensions with the most
+ * segmentations. Inputs are built from whole syllables so that every prefix
+ * kept segments, which is what ambiguity compounds on, e.g. vowel chains and
+ * n/ng boundaries.
+ */
+std::vector<Candidate> FindWorstInputs(
+    const std::shared_ptr<SyllableIndex>& index, size_t max_length)
+{
+  std::vector<std::vector<Candidate>> beams(max_length + 1);
+  beams[0].push_back({1, std::string()});
+  SyllableSegmentor segmentor(index);
+  for (size_t length = 0; length <= max_length; ++length) {
+    auto& beam = beams[length];
+    std::sort(beam.begin(), beam.end(),
+              [](const Candidate& a, const Candidate& b) {
+                return a.first != b.first ? a.first > b.first
+                                          : a.second < b.second;
+              });
+    beam.erase(std::unique(beam.begin(), beam.end()), beam.end());
+    if (beam.size() > kBeamWidth) {
+      beam.resize(kBeamWidth);
+    }
+    for (const auto& candidate : beam) {
+      for (int16_t idx = 0; idx < index->size(); ++idx) {
+        const auto syllable = index->SyllableAt(idx);
+        if (length + syllable.size() > max_length) {
+          continue;
+        }
+        auto input = candidate.second;
+        input.append(syllable.data(), syllable.size());
+        segmentor.Clear();
+        segmentor.AppendPhones(input);
+        beams[input.size()].push_back(
+            {segmentor.CountSegmentations(), std::move(input)});
+      }
+    }
+  }
+
+  std::vector<Candidate> worst;
+  for (size_t length = 1; length <= max_length; ++length) {
+    if (!beams[length].empty()) {
+      worst.push_back(beams[length].front());
+    }
+  }
+  return worst;
+}
+
+// Joins syllables drawn with their dict frequency, without separators, as
+// users type them.
+std::vector<std::string> MakeSentences(const SyllableIndex& index,
+                                       size_t count)
+{
+  std::vector<double> weights;
+  for (int16_t idx = 0; idx < index.size(); ++idx) {
+    weights.push_back(std::exp(-index.GetCost(idx)));
+  }
+  std::mt19937 rng(kSentenceSeed);
+  std::discrete_distribution<int16_t> syllables(weights.begin(),
+                                                weights.end());
+  std::uniform_int_distribution<int> lengths(kMinSentenceSyllables,
+                                             kMaxSentenceSyllables);
+  std::vector<std::string> sentences;
+  for (size_t i = 0; i < count; ++i) {
+    std::string sentence;
+    for (auto n = lengths(rng); n > 0; --n) {
+      const auto syllable = index.SyllableAt(syllables(rng));
+      sentence.append(syllable.data(), syllable.size());
+    }
+    sentences.push_back(std::move(sentence));
+  }
+  return sentences;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  const std::string mode = argc == 5 ? argv[2] : "";
+  if (mode != "worst" && mode != "sentences") {
+    std::cerr << "Usage: " << argv[0]
+              << " <syllable_list.csv> worst <max_length> <output.txt>\n"
+              << "       " << argv[0]
+              << " <syllable_list.csv> sentences <count> <output.txt>"
+              << std::endl;
+    return 1;
+  }
+  try {
+    auto index = SyllableIndex::CreateShared(argv[1]);
+    const auto n = std::stoul(argv[3]);
+    if (mode == "worst" && n >= INT16_MAX) {
+      throw std::length_error("Too many phones to segment.");
+    }
+    std::ofstream out(argv[4], out.out | out.trunc);
+    if (!out.is_open()) {
+      throw std::invalid_argument(std::string("Cannot write to ") + argv[4]);
+    }
+    if (mode == "worst") {
+      for (const auto& [count, input] : FindWorstInputs(index, n)) {
+        out << input << "\n";
+        std::cerr << input.size() << " " << count << "\n";
+      }
+    } else {
+      for (const auto& sentence : MakeSentences(*index, n)) {
+        out << sentence << "\n";
+      }
+    }
+    if (!out.good()) {
+      throw std::invalid_argument(std::string("Cannot write to ") + argv[4]);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+// Generates a header embedding the syllable dict file as constexpr tables.
+// The tables are those a SyllableIndex serves lookups from, so the embedded
+// index views them without building anything at runtime.
+//
+// Usage: epinyin_gen_table syllable_list.csv syllable_table.hpp
+
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+#include "syllable_segmentation.hpp"
+
+namespace {
+
+using namespace epinyin;
+
+const size_t kItemsPerLine = 8;
+
+template <typename T, typename F>
+void WriteArray(std::ostream& out, const std::vector<T>& items, F&& format)
+{
+  for (size_t i = 0; i < items.size(); ++i) {
+    out << (i % kItemsPerLine == 0 ? "\n    " : " ");
+    format(items[i]);
+    out << ",";
+  }
+  out << "\n};\n";
+}
+
+void WriteTrie(std::ostream& out, const char* name,
+               absl::Span<const ReversedTrieNode> trie)
+{
+  out << "\nconstexpr ReversedTrieNode " << name << "[] = {\n";
+  for (const auto& node : trie) {
+    out << "    {{";
+    for (size_t i = 0; i < node.children_.size(); ++i) {
+      out << (i == 0 ? "" : ", ") << node.children_[i];
+    }
+    out << "}, " << node.syllable_idx_ << "},\n";
+  }
+  out << "};\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <syllable_list.csv> <output.hpp>"
+              << std::endl;
+    return 1;
+  }
+  auto records = ReadSyllableList(argv[1]);
+  if (records.empty() || records.size() > INT16_MAX) {
+    std::cerr << "Unexpected number of syllables in " << argv[1] << std::endl;
+    return 1;
+  }
+  std::vector<std::string_view> syllables;
+  std::vector<int32_t> frequencies;
+  for (const auto& record : records) {
+    syllables.push_back(record.syllable_);
+    frequencies.push_back(record.frequency_);
+  }
+  const SyllableIndex index(syllables, frequencies);
+  const auto tables = index.tables();
+
+  std::ofstream out(argv[2], out.out | out.trunc);
+  if (!out.is_open()) {
+    std::cerr << "Cannot write to " << argv[2] << std::endl;
+    return 1;
+  }
+  out << "// Generated by epinyin_gen_table from syllable_list.csv. Do not "
+         "edit.\n\n"
+         "#pragma once\n\n"
+         "#include <cstdint>\n"
+         "#include <memory>\n"
+         "#include <string_view>\n\n"
+         "#include \"syllable_segmentation.hpp\"\n\n"
+         "namespace epinyin {\n"
+         "namespace embedded {\n\n";
+  out << "constexpr size_t kNumSyllables = " << records.size() << ";\n";
+
+  out << "\nconstexpr char kPool[] = \"" << tables.pool_ << "\";\n";
+  out << "\nconstexpr uint32_t kSyllableOffsets[kNumSyllables + 1] = {";
+  WriteArray(out,
+             std::vector<uint32_t>(tables.syllable_offsets_.begin(),
+                                   tables.syllable_offsets_.end()),
+             [&](uint32_t offset) { out << offset; });
+  // Hexadecimal floats keep the costs exact.
+  out << "\nconstexpr float kCosts[kNumSyllables] = {";
+  WriteArray(out, std::vector<float>(tables.costs_.begin(), tables.costs_.end()),
+             [&](float cost) { out << std::hexfloat << cost << "f"; });
+  WriteTrie(out, "kTrie", tables.trie_);
+  WriteTrie(out, "kPartialTrie", tables.partial_trie_);
+
+  out << "\n"
+         "}  // namespace embedded\n\n"
+         "// Views the embedded tables, nothing is parsed or built.\n"
+         "inline std::shared_ptr<SyllableIndex> CreateEmbeddedSyllableIndex()\n"
+         "{\n"
+         "  IndexTables tables;\n"
+         "  tables.pool_ = std::string_view(embedded::kPool,\n"
+         "                                  sizeof(embedded::kPool) - 1);\n"
+         "  tables.syllable_offsets_ = embedded::kSyllableOffsets;\n"
+         "  tables.costs_ = embedded::kCosts;\n"
+         "  tables.trie_ = embedded::kTrie;\n"
+         "  tables.partial_trie_ = embedded::kPartialTrie;\n";
+  out << "  tables.min_syllable_length_ = " << tables.min_syllable_length_
+      << ";\n"
+      << "  tables.max_syllable_length_ = " << tables.max_syllable_length_
+      << ";\n"
+      << "  tables.max_look_back_ = {";
+  for (size_t i = 0; i < tables.max_look_back_.size(); ++i) {
+    out << (i == 0 ? "" : ", ") << tables.max_look_back_[i];
+  }
+  out << "};\n"
+         "  return SyllableIndex::ViewTables(tables);\n"
+         "}\n\n"
+         "}  // namespace epinyin\n";
+  return out.good() ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+// Replays recorded keystrokes against a SyllableSegmentor the way an input
+// method drives it, asking for every segmentation after each keystroke, and
+// reports the latency percentiles.
+//
+// Each line of the log is typed into an empty segmentor and committed at the
+// end of the line. A '<' in a line is a backspace, every other byte is typed
+// with AppendPhone().
+//
+// Usage: epinyin_replay syllable_list.csv keystrokes.txt
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include "syllable_segmentation.hpp"
+
+namespace {
+
+using namespace epinyin;
+
+const char kBackspace = '<';
+
+/*
+ * Latency histogram with a bounded relative error, in the manner of HDR
+ * histograms. Values are bucketed by their highest set bit, and each of
+ * those buckets is split linearly into 2^kSubBucketBits sub-buckets, so a
+ * recorded value is off by less than 1 / 2^kSubBucketBits of itself.
+ */
+class LatencyHistogram
+{
+ public:
+  static const int kSubBucketBits = 5;
+  static const uint64_t kSubBuckets = 1u << kSubBucketBits;
+
+  LatencyHistogram() : counts_((64 - kSubBucketBits + 1) * kSubBuckets) {}
+
+  void Record(uint64_t nanos)
+  {
+    ++counts_[BucketOf(nanos)];
+    ++total_;
+    max_ = std::max(max_, nanos);
+  }
+
+  // The smallest recorded value that |quantile| of the values are at most,
+  // up to the bucket precision.
+  uint64_t Percentile(double quantile) const
+  {
+    const auto rank = static_cast<uint64_t>(std::ceil(quantile * total_));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < counts_.size(); ++bucket) {
+      seen += counts_[bucket];
+      if (seen >= std::max<uint64_t>(rank, 1)) {
+        return std::min(HighestOf(bucket), max_);
+      }
+    }
+    return max_;
+  }
+
+  uint64_t total() const { return total_; }
+  uint64_t max() const { return max_; }
+
+ private:
+  // Values below kSubBuckets get a bucket each, larger ones share a bucket
+  // with the values that agree on their kSubBucketBits leading bits.
+  static size_t BucketOf(uint64_t value)
+  {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    int shift = 64 - __builtin_clzll(value) - kSubBucketBits - 1;
+    return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+  }
+
+  static uint64_t HighestOf(size_t bucket)
+  {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    int shift = bucket / kSubBuckets - 1;
+    uint64_t sub_bucket = bucket % kSubBuckets + kSubBuckets;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t total_ = 0;
+  uint64_t max_ = 0;
+};
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <syllable_list.csv> <keystrokes.txt>"
+              << std::endl;
+    return 1;
+  }
+  std::ifstream fin(argv[2]);
+  if (!fin.is_open()) {
+    std::cerr << "Cannot read keystrokes from " << argv[2] << std::endl;
+    return 1;
+  }
+
+  SyllableSegmentor segmentor(SyllableIndex::CreateShared(argv[1]));
+  LatencyHistogram histogram;
+  std::string line;
+  std::string slowest_input;
+  size_t num_results = 0;
+  while (getline(fin, line)) {
+    segmentor.Clear();
+    std::string input;
+    for (auto key : line) {
+      const auto start = std::chrono::steady_clock::now();
+      if (key == kBackspace) {
+        if (segmentor.size() > 0) {
+          segmentor.PopLastPhone();
+        }
+      } else {
+        segmentor.AppendPhone(key);
+      }
+      num_results += segmentor.GetSyllableList().size();
+      const uint64_t elapsed =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+
+      if (key == kBackspace) {
+        if (!input.empty()) {
+          input.pop_back();
+        }
+      } else {
+        input.push_back(key);
+      }
+      if (elapsed > histogram.max()) {
+        slowest_input = input;
+      }
+      histogram.Record(elapsed);
+    }
+  }
+
+  std::cout << "keystrokes " << histogram.total() << "\n"
+            << "results " << num_results << "\n";
+  for (auto quantile : {0.5, 0.99, 0.999}) {
+    std::cout << "p" << quantile * 100 << " " << histogram.Percentile(quantile)
+              << " ns\n";
+  }
+  std::cout << "max " << histogram.max() << " ns at \"" << slowest_input
+            << "\"" << std::endl;
+  return 0;
+}
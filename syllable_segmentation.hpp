@@ -14,78 +14,359 @@
 // TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
 // THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <deque>
 #include <exception>
 #include <fstream>
+#include <functional>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <queue>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
-#include <boost/bimap.hpp>
+#include <absl/types/span.h>
+
+// Define to 1 to count the work segmentors do, see SegmentationStats.
+#ifndef EPINYIN_ENABLE_STATS
+#define EPINYIN_ENABLE_STATS 0
+#endif
 
 namespace epinyin {
 
-const auto EmptyPhone = '\0';
+constexpr bool kEnableStats = EPINYIN_ENABLE_STATS;
+
 const size_t kNumRootPhoneElement = 1;
-const auto kMaxPhoneLength = 5;
 const auto kDefaultPinYinSyllableSeparator = '`';
+// Typed separators are stored as apostrophes in the phones.
+const auto kPhoneSeparator = '\'';
+const size_t kNumPhoneLetters = 26;
+// Incoming edges of a lattice position are kept as a bitmask of lengths.
+const size_t kMaxSyllableLength = 32;
+// Rendered prefix segmentations are cached up to this many per position.
+const uint64_t kMaxCachedSegmentations = 4096;
+// Beyond this many cached strings in total, the positions no later position
+// renders from are evicted.
+const size_t kMaxCachedStrings = 1 << 16;
+// Marks a partial last syllable in rendered segmentations.
+const auto kPartialSyllableMarker = '*';
 
-struct Syllable
+/*
+ * A lattice edge spanning |length_| phones which spell the syllable
+ * |syllable_idx_|. The start position is implied by where the edge is stored.
+ * A typed separator is an edge of length one with kSeparatorEdge instead of a
+ * syllable. A partial edge spells the start of |syllable_idx_| only.
+ */
+struct Edge
 {
-  int32_t phone_idx_ = -1;
+  uint8_t length_ = 0;
+  bool partial_ = false;
   int16_t syllable_idx_ = -1;
-
-  int16_t stored_in_phone_idx_ = -1;
-  int16_t pos_ = -1;
-  Syllable(int32_t phone_idx, int16_t syllable_idx, int16_t stored_in_phone_idx,
-           int16_t pos)
-      : phone_idx_(phone_idx),
-        syllable_idx_(syllable_idx),
-        stored_in_phone_idx_(stored_in_phone_idx),
-        pos_(pos)
+  Edge(uint8_t length, int16_t syllable_idx, bool partial = false)
+      : length_(length), partial_(partial), syllable_idx_(syllable_idx)
   {}
 };
+static_assert(sizeof(Edge) == 4, "Edges are packed to 4 bytes.");
+const int16_t kSeparatorEdge = -1;
+
+struct SyllableRecord
+{
+  std::string syllable_;
+  int32_t frequency_ = 0;
+};
+
+/*
+ * Reads the syllable dict file. Each line after the header holds a syllable
+ * and its frequency separated by a comma.
+ */
+inline std::vector<SyllableRecord> ReadSyllableList(const std::string& path)
+{
+  std::vector<SyllableRecord> records;
+  std::fstream fin(path, fin.in);
+  if (!fin.is_open()) {
+    throw std::invalid_argument("Invalid path to load syllables from " + path);
+  }
+  std::string line;
+  getline(fin, line);  // skip header
+
+  while (getline(fin, line)) {
+    std::istringstream line_ss(line);
+    SyllableRecord record;
+    if (getline(line_ss, record.syllable_, ',')) {
+      line_ss >> record.frequency_;
+      records.push_back(std::move(record));
+    }
+  }
+  return records;
+}
+
+/*
+ * A node of the reversed syllable trie. Edges are labelled with phones in
+ * reverse order, so walking from the root spells a syllable from its last
+ * phone to its first one. Child 0 means no edge since no edge leads back to
+ * the root.
+ */
+struct ReversedTrieNode
+{
+  std::array<int16_t, kNumPhoneLetters> children_{};
+  int16_t syllable_idx_ = -1;
+};
+
+static_assert(std::is_trivially_copyable<ReversedTrieNode>::value,
+              "Trie nodes are stored in index files as they are.");
+
+const char kIndexFileMagic[4] = {'E', 'P', 'Y', 'I'};
+const uint32_t kIndexFileVersion = 2;
+const uint32_t kIndexFileAlignment = 8;
+
+/*
+ * Header of a compiled index file. Sections are addressed by byte offsets
+ * from the start of the file, so the file can be mapped anywhere.
+ */
+struct IndexFileHeader
+{
+  char magic_[4];
+  uint32_t version_;
+  uint32_t num_syllables_;
+  uint32_t num_trie_nodes_;
+  uint32_t num_partial_trie_nodes_;
+  uint32_t pool_size_;
+  uint32_t syllable_offsets_offset_;
+  uint32_t costs_offset_;
+  uint32_t trie_offset_;
+  uint32_t partial_trie_offset_;
+  uint32_t pool_offset_;
+  int16_t min_syllable_length_;
+  int16_t max_syllable_length_;
+  std::array<int16_t, kNumPhoneLetters> max_look_back_;
+};
 
-struct Phone
+/*
+ * The tables a SyllableIndex serves lookups from, see
+ * SyllableIndex::tables().
+ */
+struct IndexTables
+{
+  std::string_view pool_;
+  absl::Span<const uint32_t> syllable_offsets_;
+  absl::Span<const float> costs_;
+  absl::Span<const ReversedTrieNode> trie_;
+  absl::Span<const ReversedTrieNode> partial_trie_;
+  int16_t min_syllable_length_ = 0;
+  int16_t max_syllable_length_ = 0;
+  std::array<int16_t, kNumPhoneLetters> max_look_back_{};
+};
+
+/*
+ * Counters of the work done by segmentors. They stay zero unless
+ * EPINYIN_ENABLE_STATS is defined to 1, and counting compiles away otherwise.
+ */
+struct SegmentationStats
 {
-  std::vector<Syllable> syllables_;
-  char phone_;
-  bool empty() const { return phone_ == EmptyPhone; }
-  explicit Phone(char phone = EmptyPhone) : phone_(phone) {}
+  // Reversed trie steps taken while building the lattice.
+  uint64_t index_probes_ = 0;
+  // Syllables found by those steps.
+  uint64_t index_hits_ = 0;
+  uint64_t edges_added_ = 0;
+  // Lattice edges entered by depth-first enumeration.
+  uint64_t nodes_visited_ = 0;
+  uint64_t results_emitted_ = 0;
+  // Bytes of the results handed out, strings and syllable ids.
+  uint64_t bytes_allocated_ = 0;
+
+  SegmentationStats& operator+=(const SegmentationStats& rhs)
+  {
+    index_probes_ += rhs.index_probes_;
+    index_hits_ += rhs.index_hits_;
+    edges_added_ += rhs.edges_added_;
+    nodes_visited_ += rhs.nodes_visited_;
+    results_emitted_ += rhs.results_emitted_;
+    bytes_allocated_ += rhs.bytes_allocated_;
+    return *this;
+  }
 };
 
-class SyllableIndex
+class SyllableIndex;
+
+/*
+ * Where stats are kept, inherited by SyllableIndex and SyllableSegmentor.
+ * The disabled versions are empty and hold no state, so they take no space
+ * and leave nothing to lock, publish or destroy.
+ */
+template <bool kEnabled>
+class StatsTotals
 {
-  typedef boost::bimap<std::string, int16_t> SyllableIndexBiMap;
-  typedef SyllableIndexBiMap::value_type SyllableIndexBiMapPosition;
+ public:
+  SegmentationStats stats() const { return SegmentationStats(); }
+  void PublishStats(const SegmentationStats&) const {}
+};
 
+template <>
+class StatsTotals<true>
+{
  public:
-  SyllableIndex(const std::string& path)
+  // Totals of the stats published by the segmentors using the index.
+  SegmentationStats stats() const
   {
-    std::fstream fin(path, fin.in);
-    if (!fin.is_open()) {
-      throw std::invalid_argument("Invalid path to load syllables from " +
-                                  path);
-    } else {
-      std::string line;
-      getline(fin, line);  // skip header
-
-      int16_t cur_idx = 0;
-      while (getline(fin, line)) {
-        std::istringstream line_ss(line);
-        std::string syllable_str;
-        if (getline(line_ss, syllable_str, ',')) {
-          index_.insert(SyllableIndexBiMapPosition(syllable_str, cur_idx++));
-        }
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+  }
+
+  void PublishStats(const SegmentationStats& stats) const
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ += stats;
+  }
+
+ private:
+  mutable std::mutex stats_mutex_;
+  mutable SegmentationStats stats_;
+};
+
+template <bool kEnabled>
+class StatsCounters
+{
+ public:
+  explicit StatsCounters(const std::shared_ptr<SyllableIndex>&) {}
+
+  const SegmentationStats& stats() const { return kNoStats; }
+
+ protected:
+  void Count(uint64_t SegmentationStats::*, uint64_t) const {}
+  void PublishStats() {}
+
+ private:
+  static constexpr SegmentationStats kNoStats{};
+};
+
+// Publishes what is left to the index on destruction, through an index
+// pointer of its own as the segmentor members are gone by then.
+template <>
+class StatsCounters<true>
+{
+ public:
+  explicit StatsCounters(const std::shared_ptr<SyllableIndex>& syllable_index)
+      : syllable_index_(syllable_index)
+  {}
+  StatsCounters(const StatsCounters& rhs) = delete;
+  void operator=(const StatsCounters& rhs) = delete;
+  ~StatsCounters() { PublishStats(); }
+
+  // Counted over the lifetime of the segmentor, see SegmentationStats.
+  const SegmentationStats& stats() const { return stats_; }
+
+ protected:
+  // Counted from const methods too, like the cached prefixes.
+  void Count(uint64_t SegmentationStats::*counter, uint64_t n) const
+  {
+    stats_.*counter += n;
+    unpublished_stats_.*counter += n;
+  }
+
+  // Defined after SyllableIndex.
+  void PublishStats();
+
+ private:
+  std::shared_ptr<SyllableIndex> syllable_index_;
+  mutable SegmentationStats stats_;
+  mutable SegmentationStats unpublished_stats_;
+};
+
+class SyllableIndex : public StatsTotals<kEnableStats>
+{
+ public:
+  /*
+   * Walks the reversed syllable trie one phone at a time. Feeding the phones
+   * preceding a position from the nearest one backwards yields every syllable
+   * ending at that position without building any string.
+   */
+  class ReverseWalker
+  {
+   public:
+    explicit ReverseWalker(absl::Span<const ReversedTrieNode> trie)
+        : trie_(trie)
+    {}
+
+    // Returns false once no syllable can end with the phones walked so far.
+    bool Step(char phone)
+    {
+      if (phone < 'a' || phone > 'z') {
+        return false;
       }
+      node_ = trie_[node_].children_[phone - 'a'];
+      return node_ != 0;
     }
 
-    if (index_.size() <= 0) {
-      throw std::invalid_argument("Syllable maps are empty.");
+    std::optional<int16_t> syllable_idx() const
+    {
+      auto idx = trie_[node_].syllable_idx_;
+      if (idx < 0) {
+        return {};
+      } else {
+        return {idx};
+      }
+    }
+
+   private:
+    absl::Span<const ReversedTrieNode> trie_;
+    int16_t node_ = 0;
+  };
+
+  SyllableIndex(const std::string& path)
+  {
+    int16_t cur_idx = 0;
+    std::vector<int32_t> frequencies;
+    for (const auto& record : ReadSyllableList(path)) {
+      Insert(record.syllable_, cur_idx++);
+      frequencies.push_back(record.frequency_);
+    }
+    LoadCosts(frequencies);
+  }
+  // Syllables without |frequencies| are all equally likely.
+  explicit SyllableIndex(absl::Span<const std::string_view> syllables,
+                         absl::Span<const int32_t> frequencies = {})
+  {
+    int16_t cur_idx = 0;
+    for (const auto& syllable : syllables) {
+      Insert(syllable, cur_idx++);
+    }
+    if (frequencies.empty()) {
+      LoadCosts(std::vector<int32_t>(syllables.size(), 1));
+    } else {
+      LoadCosts(frequencies);
+    }
+  }
+  SyllableIndex(const SyllableIndex& rhs) = delete;
+  void operator=(const SyllableIndex& rhs) = delete;
+  ~SyllableIndex()
+  {
+    if (mapping_ != nullptr) {
+      munmap(const_cast<void*>(mapping_), mapping_size_);
     }
   }
 
@@ -93,178 +374,1551 @@ class SyllableIndex
   {
     return std::make_shared<SyllableIndex>(path);
   }
-  std::optional<int16_t> GetIndex(const std::string& syllable) const
+
+  /*
+   * Serves lookups straight from |tables|, which must outlive the index.
+   * They are not checked, so they should come from tables() of another
+   * index, as the tables embedded by epinyin_gen_table do.
+   */
+  static std::shared_ptr<SyllableIndex> ViewTables(const IndexTables& tables)
+  {
+    std::shared_ptr<SyllableIndex> index(new SyllableIndex());
+    index->AssignTables(tables);
+    return index;
+  }
+
+  IndexTables tables() const
   {
-    const auto& m = index_.left;
-    if (m.find(syllable) == m.end()) {
+    return {pool_,
+            syllable_offsets_,
+            costs_,
+            trie_,
+            partial_trie_,
+            min_syllable_length_,
+            max_syllable_length_,
+            max_look_back_};
+  }
+
+  /*
+   * Maps an index file written by Save() read-only and serves lookups
+   * directly from the mapping, so processes share one page cache copy.
+   */
+  static std::shared_ptr<SyllableIndex> OpenMapped(const std::string& path)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::invalid_argument("Invalid path to map index from " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        st.st_size < static_cast<off_t>(sizeof(IndexFileHeader))) {
+      close(fd);
+      throw std::invalid_argument("Invalid index file " + path);
+    }
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      throw std::invalid_argument("Cannot map index file " + path);
+    }
+    std::shared_ptr<SyllableIndex> index(new SyllableIndex());
+    index->mapping_ = mapping;
+    index->mapping_size_ = st.st_size;
+    index->ViewMapping(path);
+    return index;
+  }
+
+  // Writes the index in the format OpenMapped() reads.
+  void Save(const std::string& path) const
+  {
+    auto align = [](uint32_t offset) {
+      return (offset + kIndexFileAlignment - 1) / kIndexFileAlignment *
+             kIndexFileAlignment;
+    };
+    IndexFileHeader header{};
+    std::copy(std::begin(kIndexFileMagic), std::end(kIndexFileMagic),
+              header.magic_);
+    header.version_ = kIndexFileVersion;
+    header.num_syllables_ = size();
+    header.num_trie_nodes_ = trie_.size();
+    header.num_partial_trie_nodes_ = partial_trie_.size();
+    header.pool_size_ = pool_.size();
+    header.syllable_offsets_offset_ = align(sizeof(header));
+    header.costs_offset_ =
+        align(header.syllable_offsets_offset_ +
+              syllable_offsets_.size() * sizeof(syllable_offsets_[0]));
+    header.trie_offset_ =
+        align(header.costs_offset_ + costs_.size() * sizeof(costs_[0]));
+    header.partial_trie_offset_ =
+        align(header.trie_offset_ + trie_.size() * sizeof(trie_[0]));
+    header.pool_offset_ =
+        align(header.partial_trie_offset_ +
+              partial_trie_.size() * sizeof(partial_trie_[0]));
+    header.min_syllable_length_ = min_syllable_length_;
+    header.max_syllable_length_ = max_syllable_length_;
+    header.max_look_back_ = max_look_back_;
+
+    std::string out(header.pool_offset_ + pool_.size(), '\0');
+    auto write = [&out](uint32_t offset, const void* data, size_t size) {
+      std::memcpy(&out[offset], data, size);
+    };
+    write(0, &header, sizeof(header));
+    write(header.syllable_offsets_offset_, syllable_offsets_.data(),
+          syllable_offsets_.size() * sizeof(syllable_offsets_[0]));
+    write(header.costs_offset_, costs_.data(),
+          costs_.size() * sizeof(costs_[0]));
+    write(header.trie_offset_, trie_.data(), trie_.size() * sizeof(trie_[0]));
+    write(header.partial_trie_offset_, partial_trie_.data(),
+          partial_trie_.size() * sizeof(partial_trie_[0]));
+    write(header.pool_offset_, pool_.data(), pool_.size());
+
+    std::ofstream fout(path, fout.out | fout.binary | fout.trunc);
+    if (!fout.write(out.data(), out.size())) {
+      throw std::invalid_argument("Cannot write index file to " + path);
+    }
+  }
+  // Looks |syllable| up by walking the reversed trie, without allocating.
+  std::optional<int16_t> GetIndex(std::string_view syllable) const
+  {
+    if (syllable.empty()) {
       return {};
-    } else {
-      int16_t idx = m.find(syllable)->second;
-      return {idx};
     }
+    auto walker = ReverseWalk();
+    for (auto iter = syllable.crbegin(); iter != syllable.crend(); ++iter) {
+      if (!walker.Step(*iter)) {
+        return {};
+      }
+    }
+    return walker.syllable_idx();
   }
 
-  std::optional<std::string> GetSyllable(int16_t idx) const
+  std::optional<std::string_view> GetSyllable(int16_t idx) const
   {
-    const auto& m = index_.right;
-    if (m.find(idx) == m.end()) {
+    if (idx < 0 || idx >= size()) {
       return {};
     } else {
-      return {m.find(idx)->second};
+      return {SyllableAt(idx)};
+    }
+  }
+
+  // Zero-copy access to the syllable of a valid index.
+  std::string_view SyllableAt(int16_t idx) const
+  {
+    return std::string_view(pool_.data() + syllable_offsets_[idx],
+                            syllable_offsets_[idx + 1] - syllable_offsets_[idx]);
+  }
+
+  int16_t size() const { return syllable_offsets_.size() - 1; }
+
+  // The negative log probability of the syllable, lower is more frequent.
+  float GetCost(int16_t idx) const { return costs_[idx]; }
+
+  ReverseWalker ReverseWalk() const { return ReverseWalker(trie_); }
+
+  /*
+   * Walks the phones of a syllable typed so far backwards, like
+   * ReverseWalk(). It yields the most frequent syllable starting with them,
+   * for phones which start some syllable but do not spell one.
+   */
+  ReverseWalker PartialWalk() const { return ReverseWalker(partial_trie_); }
+
+  int16_t min_syllable_length() const { return min_syllable_length_; }
+  int16_t max_syllable_length() const { return max_syllable_length_; }
+
+  // The longest syllable ending with |phone|, or 0 if none does.
+  int16_t MaxLookBack(char phone) const
+  {
+    if (phone < 'a' || phone > 'z') {
+      return 0;
     }
+    return max_look_back_[phone - 'a'];
   }
 
  private:
-  SyllableIndexBiMap index_;
+  SyllableIndex() = default;
+
+  void AssignTables(const IndexTables& tables)
+  {
+    pool_ = tables.pool_;
+    syllable_offsets_ = tables.syllable_offsets_;
+    costs_ = tables.costs_;
+    trie_ = tables.trie_;
+    partial_trie_ = tables.partial_trie_;
+    min_syllable_length_ = tables.min_syllable_length_;
+    max_syllable_length_ = tables.max_syllable_length_;
+    max_look_back_ = tables.max_look_back_;
+  }
+
+  // Points the tables into the mapping after checking that every section and
+  // every offset stored in them stays within the file.
+  void ViewMapping(const std::string& path)
+  {
+    const auto* base = static_cast<const char*>(mapping_);
+    IndexFileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    auto fits = [this](uint64_t offset, uint64_t size) {
+      return offset % kIndexFileAlignment == 0 && offset <= mapping_size_ &&
+             size <= mapping_size_ - offset;
+    };
+    if (!std::equal(std::begin(kIndexFileMagic), std::end(kIndexFileMagic),
+                    header.magic_) ||
+        header.version_ != kIndexFileVersion || header.num_syllables_ <= 0 ||
+        header.num_syllables_ > INT16_MAX || header.num_trie_nodes_ <= 0 ||
+        header.num_trie_nodes_ > INT16_MAX ||
+        header.num_partial_trie_nodes_ <= 0 ||
+        header.num_partial_trie_nodes_ > INT16_MAX ||
+        !fits(header.syllable_offsets_offset_,
+              (header.num_syllables_ + 1) * sizeof(uint32_t)) ||
+        !fits(header.costs_offset_, header.num_syllables_ * sizeof(float)) ||
+        !fits(header.trie_offset_,
+              header.num_trie_nodes_ * sizeof(ReversedTrieNode)) ||
+        !fits(header.partial_trie_offset_,
+              header.num_partial_trie_nodes_ * sizeof(ReversedTrieNode)) ||
+        !fits(header.pool_offset_, header.pool_size_)) {
+      throw std::invalid_argument("Invalid index file " + path);
+    }
+    IndexTables tables;
+    tables.syllable_offsets_ = absl::MakeSpan(
+        reinterpret_cast<const uint32_t*>(base + header.syllable_offsets_offset_),
+        header.num_syllables_ + 1);
+    tables.costs_ = absl::MakeSpan(
+        reinterpret_cast<const float*>(base + header.costs_offset_),
+        header.num_syllables_);
+    tables.trie_ = absl::MakeSpan(
+        reinterpret_cast<const ReversedTrieNode*>(base + header.trie_offset_),
+        header.num_trie_nodes_);
+    tables.partial_trie_ = absl::MakeSpan(
+        reinterpret_cast<const ReversedTrieNode*>(base +
+                                                  header.partial_trie_offset_),
+        header.num_partial_trie_nodes_);
+    tables.pool_ =
+        std::string_view(base + header.pool_offset_, header.pool_size_);
+    tables.min_syllable_length_ = header.min_syllable_length_;
+    tables.max_syllable_length_ = header.max_syllable_length_;
+    tables.max_look_back_ = header.max_look_back_;
+    AssignTables(tables);
+
+    for (size_t i = 0; i < syllable_offsets_.size(); ++i) {
+      if (syllable_offsets_[i] > pool_.size() ||
+          (i > 0 && syllable_offsets_[i] < syllable_offsets_[i - 1])) {
+        throw std::invalid_argument("Invalid syllables in index file " + path);
+      }
+    }
+    for (auto trie : {trie_, partial_trie_}) {
+      for (const auto& node : trie) {
+        for (auto child : node.children_) {
+          if (child < 0 || static_cast<size_t>(child) >= trie.size()) {
+            throw std::invalid_argument("Invalid trie in index file " + path);
+          }
+        }
+        if (node.syllable_idx_ >= size()) {
+          throw std::invalid_argument("Invalid trie in index file " + path);
+        }
+      }
+    }
+    // Edits repair the lattice within the longest syllable, so it must bound
+    // every syllable the trie walks can find.
+    const int16_t max_length = kMaxSyllableLength;
+    int16_t max_look_back = 0;
+    for (auto look_back : max_look_back_) {
+      if (look_back < 0 || look_back > max_length) {
+        throw std::invalid_argument("Invalid lengths in index file " + path);
+      }
+      max_look_back = std::max(max_look_back, look_back);
+    }
+    if (min_syllable_length_ < 1 ||
+        min_syllable_length_ > max_syllable_length_ ||
+        max_syllable_length_ > max_length ||
+        max_syllable_length_ != max_look_back) {
+      throw std::invalid_argument("Invalid lengths in index file " + path);
+    }
+  }
+
+  // Turns frequencies into costs with add-one smoothing, so that syllables
+  // with no recorded frequency stay usable.
+  void LoadCosts(absl::Span<const int32_t> frequencies)
+  {
+    const auto num_syllables = syllable_offsets_storage_.size() - 1;
+    if (num_syllables <= 0) {
+      throw std::invalid_argument("Syllable maps are empty.");
+    }
+    if (frequencies.size() != num_syllables) {
+      throw std::invalid_argument("Syllable frequencies do not match.");
+    }
+    double total = 0;
+    for (auto frequency : frequencies) {
+      total += std::max(frequency, 0) + 1;
+    }
+    for (auto frequency : frequencies) {
+      costs_storage_.push_back(-std::log((std::max(frequency, 0) + 1) / total));
+    }
+
+    pool_ = pool_storage_;
+    syllable_offsets_ = syllable_offsets_storage_;
+    trie_ = trie_storage_;
+    costs_ = costs_storage_;
+    BuildPartialTrie();
+  }
+
+  // Inserts the proper prefixes of every syllable which are not syllables
+  // themselves, reversed. Syllables are visited from the cheapest, so each
+  // prefix keeps its most frequent completion.
+  void BuildPartialTrie()
+  {
+    std::vector<int16_t> order(size());
+    for (int16_t idx = 0; idx < size(); ++idx) {
+      order[idx] = idx;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](int16_t a, int16_t b) {
+      return costs_[a] < costs_[b];
+    });
+    auto& trie = partial_trie_storage_;
+    for (auto idx : order) {
+      const auto syllable = SyllableAt(idx);
+      for (size_t length = 1; length < syllable.size(); ++length) {
+        const auto prefix = syllable.substr(0, length);
+        if (GetIndex(prefix)) {
+          continue;
+        }
+        int16_t node = 0;
+        for (auto iter = prefix.crbegin(); iter != prefix.crend(); ++iter) {
+          if (trie[node].children_[*iter - 'a'] == 0) {
+            if (trie.size() >= INT16_MAX) {
+              throw std::length_error("Too many phones in syllable maps.");
+            }
+            trie[node].children_[*iter - 'a'] = trie.size();
+            trie.emplace_back();
+          }
+          node = trie[node].children_[*iter - 'a'];
+        }
+        if (trie[node].syllable_idx_ < 0) {
+          trie[node].syllable_idx_ = idx;
+        }
+      }
+    }
+    partial_trie_ = partial_trie_storage_;
+  }
+
+  void Insert(std::string_view syllable, int16_t syllable_idx)
+  {
+    InsertReversed(syllable, syllable_idx);
+    pool_storage_.append(syllable.data(), syllable.size());
+    syllable_offsets_storage_.push_back(pool_storage_.size());
+  }
+
+  void InsertReversed(std::string_view syllable, int16_t syllable_idx)
+  {
+    if (syllable.empty()) {
+      throw std::invalid_argument("Empty syllable in syllable maps.");
+    }
+    int16_t node = 0;
+    for (auto iter = syllable.crbegin(); iter != syllable.crend(); ++iter) {
+      if (*iter < 'a' || *iter > 'z') {
+        throw std::invalid_argument("Invalid phone in syllable " +
+                                    std::string(syllable));
+      }
+      auto& trie = trie_storage_;
+      if (trie[node].children_[*iter - 'a'] == 0) {
+        if (trie.size() >= INT16_MAX) {
+          throw std::length_error("Too many phones in syllable maps.");
+        }
+        trie[node].children_[*iter - 'a'] = trie.size();
+        trie.emplace_back();
+      }
+      node = trie[node].children_[*iter - 'a'];
+    }
+    trie_storage_[node].syllable_idx_ = syllable_idx;
+
+    if (syllable.size() > kMaxSyllableLength) {
+      throw std::length_error("Syllable is too long: " +
+                              std::string(syllable));
+    }
+    int16_t length = syllable.size();
+    auto& look_back = max_look_back_[syllable.back() - 'a'];
+    look_back = std::max(look_back, length);
+    max_syllable_length_ = std::max(max_syllable_length_, length);
+    min_syllable_length_ = min_syllable_length_ == 0
+                               ? length
+                               : std::min(min_syllable_length_, length);
+  }
+
+  // Syllables are stored back to back, the syllable of index i spans
+  // pool_[syllable_offsets_[i], syllable_offsets_[i + 1]). The tables are
+  // views into either the storage below or a mapped index file.
+  std::string_view pool_;
+  absl::Span<const uint32_t> syllable_offsets_;
+  absl::Span<const ReversedTrieNode> trie_;
+  // Reversed proper prefixes of the syllables, see PartialWalk().
+  absl::Span<const ReversedTrieNode> partial_trie_;
+  absl::Span<const float> costs_;
+  std::array<int16_t, kNumPhoneLetters> max_look_back_{};
+  int16_t min_syllable_length_ = 0;
+  int16_t max_syllable_length_ = 0;
+
+  std::string pool_storage_;
+  std::vector<uint32_t> syllable_offsets_storage_ = std::vector<uint32_t>(1);
+  std::vector<ReversedTrieNode> trie_storage_ =
+      std::vector<ReversedTrieNode>(1);
+  std::vector<ReversedTrieNode> partial_trie_storage_ =
+      std::vector<ReversedTrieNode>(1);
+  std::vector<float> costs_storage_;
+
+  const void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
 };
 
+inline void StatsCounters<true>::PublishStats()
+{
+  syllable_index_->PublishStats(unpublished_stats_);
+  unpublished_stats_ = SegmentationStats();
+}
+
+/*
+ * Lowercases |phones| into |out|, which must hold as many chars, and turns
+ * |separator| into apostrophes. Returns false if any byte is not a letter,
+ * an apostrophe or |separator|. Sixteen bytes are checked at a time where
+ * SSE2 is available.
+ */
+inline bool NormalizePhones(std::string_view phones, char* out,
+                            char separator = kPhoneSeparator)
+{
+  size_t i = 0;
+#if defined(__SSE2__)
+  const auto upper_first = _mm_set1_epi8('A' - 1);
+  const auto upper_last = _mm_set1_epi8('Z' + 1);
+  const auto lower_first = _mm_set1_epi8('a' - 1);
+  const auto lower_last = _mm_set1_epi8('z' + 1);
+  const auto apostrophe = _mm_set1_epi8(kPhoneSeparator);
+  const auto separators = _mm_set1_epi8(separator);
+  const auto case_bit = _mm_set1_epi8(0x20);
+  for (; i + 16 <= phones.size(); i += 16) {
+    auto chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(phones.data() + i));
+    auto is_upper = _mm_and_si128(_mm_cmpgt_epi8(chunk, upper_first),
+                                  _mm_cmpgt_epi8(upper_last, chunk));
+    chunk = _mm_or_si128(chunk, _mm_and_si128(is_upper, case_bit));
+    auto is_separator = _mm_cmpeq_epi8(chunk, separators);
+    chunk = _mm_or_si128(_mm_andnot_si128(is_separator, chunk),
+                         _mm_and_si128(is_separator, apostrophe));
+    auto is_valid = _mm_or_si128(
+        _mm_and_si128(_mm_cmpgt_epi8(chunk, lower_first),
+                      _mm_cmpgt_epi8(lower_last, chunk)),
+        _mm_cmpeq_epi8(chunk, apostrophe));
+    if (_mm_movemask_epi8(is_valid) != 0xFFFF) {
+      return false;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), chunk);
+  }
+#endif
+  for (; i < phones.size(); ++i) {
+    auto phone = phones[i];
+    if (phone >= 'A' && phone <= 'Z') {
+      phone += 'a' - 'A';
+    }
+    if (phone == separator) {
+      phone = kPhoneSeparator;
+    }
+    if ((phone < 'a' || phone > 'z') && phone != kPhoneSeparator) {
+      return false;
+    }
+    out[i] = phone;
+  }
+  return true;
+}
+
 /*
  * Creates a SyllableSegmentor to split syllables.
+ *
+ * Phones are stored as a lattice whose positions sit between phones. Every
+ * syllable spanning phones [start, start + length) is an edge leaving
+ * |start|. Edges live in one contiguous array grouped by start position, in
+ * compressed sparse row form: the edges leaving |p| are
+ * edges_[edge_offsets_[p], edge_offsets_[p + 1]).
  */
-class SyllableSegmentor
+class SyllableSegmentor : public StatsCounters<kEnableStats>
 {
  public:
   SyllableSegmentor(
       const std::shared_ptr<SyllableIndex>& syllable_index,
       const char syllable_separator = kDefaultPinYinSyllableSeparator)
-      : phones_(kNumRootPhoneElement),
+      : StatsCounters(syllable_index),
+        edge_offsets_(kNumRootPhoneElement + 1),
+        incoming_lengths_(kNumRootPhoneElement),
+        reaches_end_(kNumRootPhoneElement, true),
+        prefix_counts_(kNumRootPhoneElement, 1),
+        prefix_lists_(kNumRootPhoneElement, {std::string()}),
         syllable_index_(syllable_index),
         syllable_separator_(std::string(1, syllable_separator))
   {}
   SyllableSegmentor(const SyllableSegmentor& rhs) = delete;
   void operator=(const SyllableSegmentor& rhs) = delete;
 
+  /*
+   * Appends a phone, lowercased like by AppendPhones(). An apostrophe or the
+   * syllable separator is a forced boundary: no syllable spans it and it is
+   * dropped from the results. Separators alone have no segmentation.
+   */
   void AppendPhone(char phone)
   {
     if (phone <= '\0') return;
+    if (phones_.size() + 1 >= INT16_MAX) {
+      throw std::length_error("Too many phones to segment.");
+    }
+
+    RemovePartialTail();
+    phones_.push_back(ToPhone(phone));
+    num_separators_ += phones_.back() == kPhoneSeparator;
+    ExtendLattice();
+    AddPartialTail();
+    reachability_dirty_ = true;
+    ++version_;
+  }
+
+  /*
+   * Appends a run of phones at once. The whole run is checked and lowercased
+   * up front, and is rejected with std::invalid_argument if it holds
+   * anything but letters and separators, leaving the segmentor unchanged.
+   */
+  void AppendPhones(std::string_view phones)
+  {
+    if (phones_.size() + phones.size() >= INT16_MAX) {
+      throw std::length_error("Too many phones to segment.");
+    }
+    const auto first = phones_.size();
+    RemovePartialTail();
+    phones_.resize(first + phones.size());
+    if (!NormalizePhones(phones, &phones_[first], syllable_separator_[0])) {
+      phones_.resize(first);
+      AddPartialTail();
+      throw std::invalid_argument("Invalid phones to segment.");
+    }
+    num_separators_ += std::count(phones_.begin() + first, phones_.end(),
+                                  kPhoneSeparator);
+    edge_offsets_.reserve(phones_.size() + kNumRootPhoneElement + 1);
+    incoming_lengths_.reserve(phones_.size() + kNumRootPhoneElement);
+    for (auto end = first + 1; end <= phones_.size(); ++end) {
+      ExtendLattice(end);
+    }
+    AddPartialTail();
+    reachability_dirty_ = true;
+    ++version_;
+  }
 
-    auto phone_idx = phones_.size();
-    phones_.push_back(Phone(phone));
-    int num_phones = 0;
-    std::vector<char> stack;
-    for (auto iter = phones_.rbegin();
-         !iter->empty() && iter != phones_.rend() &&
-         num_phones < kMaxPhoneLength;
-         iter++, ++num_phones) {
-      stack.push_back(iter->phone_);
-      std::string possible_syllables(stack.crbegin(), stack.crend());
-      if (auto syllable_idx = syllable_index_->GetIndex(possible_syllables);
-          syllable_idx) {
-        // stored in the phone node before the current phone in the stack
-        auto next_iter = std::next(iter);
-        auto cur_phone_idx =
-            std::distance(begin(phones_), next_iter.base()) - 1;
-        next_iter->syllables_.push_back(Syllable(phone_idx, *syllable_idx,
-                                                 cur_phone_idx,
-                                                 next_iter->syllables_.size()));
+  /*
+   * With |enabled|, phones at the end which start some syllable without
+   * spelling one are kept as a partial last syllable, so that input typed
+   * halfway through a syllable still segments. Partial syllables are
+   * rendered as their phones followed by kPartialSyllableMarker. In syllable
+   * ids and TopK() they stand for their most frequent completion and the
+   * segmentation is flagged as partial, and partial_syllable() of the
+   * iterator gives the phones typed.
+   */
+  void EnablePartialTail(bool enabled = true)
+  {
+    RemovePartialTail();
+    partial_tail_ = enabled;
+    AddPartialTail();
+    reachability_dirty_ = true;
+    ++version_;
+  }
+
+  // Whether some segmentation of the phones after |pos| exists.
+  bool ReachesEnd(int16_t pos) const
+  {
+    UpdateReachability();
+    return reaches_end_[pos];
+  }
+
+  /*
+   * Forward iterator over the segmentations of the phones in depth-first
+   * order. A segmentation is a span of syllable ids, valid until the iterator
+   * is advanced. Segmentations are produced one at a time on increment.
+   */
+  class SegmentationIterator
+  {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef absl::Span<const int16_t> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef value_type reference;
+
+    SegmentationIterator() = default;
+    explicit SegmentationIterator(const SyllableSegmentor* segmentor)
+        : segmentor_(segmentor), next_(segmentor->edge_offsets_[0])
+    {
+      segmentor_->UpdateReachability();
+      Advance();
+    }
+
+    reference operator*() const { return syllable_ids_; }
+
+    // Number of lattice edges entered so far, kept by the end iterator.
+    size_t visited_nodes() const { return visited_nodes_; }
+
+    // Number of leading syllable ids shared with the previous segmentation.
+    size_t unchanged_prefix() const { return unchanged_prefix_; }
+
+    // The phones of the last syllable if it is partial.
+    std::optional<std::string_view> partial_syllable() const
+    {
+      if (stack_.empty() || !segmentor_->edges_[stack_.back()].partial_) {
+        return {};
+      }
+      const auto length = segmentor_->edges_[stack_.back()].length_;
+      return std::string_view(segmentor_->phones_).substr(pos_ - length,
+                                                          length);
+    }
+    SegmentationIterator& operator++()
+    {
+      Advance();
+      return *this;
+    }
+    SegmentationIterator operator++(int)
+    {
+      auto r = *this;
+      Advance();
+      return r;
+    }
+    bool operator==(const SegmentationIterator& rhs) const
+    {
+      return segmentor_ == rhs.segmentor_ && stack_ == rhs.stack_ &&
+             next_ == rhs.next_;
+    }
+    bool operator!=(const SegmentationIterator& rhs) const
+    {
+      return !(*this == rhs);
+    }
+
+   private:
+    friend class SyllableSegmentor;
+
+    // Resumes the depth-first walk until the path reaches the last position.
+    void Advance()
+    {
+      const auto& offsets = segmentor_->edge_offsets_;
+      const auto& edges = segmentor_->edges_;
+      const int16_t end = segmentor_->size();
+      unchanged_prefix_ = syllable_ids_.size();
+      while (segmentor_->num_separators_ < end) {
+        if (next_ < offsets[pos_ + 1]) {
+          if (!segmentor_->reaches_end_[pos_ + edges[next_].length_]) {
+            ++next_;
+            continue;
+          }
+          stack_.push_back(next_);
+          if (edges[next_].syllable_idx_ != kSeparatorEdge) {
+            syllable_ids_.push_back(edges[next_].syllable_idx_);
+          }
+          ++visited_nodes_;
+          pos_ += edges[next_].length_;
+          next_ = offsets[pos_];
+          if (pos_ == end) {
+            return;
+          }
+        } else if (!stack_.empty()) {
+          next_ = stack_.back();
+          stack_.pop_back();
+          if (edges[next_].syllable_idx_ != kSeparatorEdge) {
+            syllable_ids_.pop_back();
+          }
+          unchanged_prefix_ = std::min(unchanged_prefix_, syllable_ids_.size());
+          pos_ -= edges[next_].length_;
+          ++next_;
+        } else {
+          break;
+        }
       }
+      // The end iterator still reports the nodes visited to get there.
+      const auto visited_nodes = visited_nodes_;
+      *this = SegmentationIterator();
+      visited_nodes_ = visited_nodes;
     }
+
+    const SyllableSegmentor* segmentor_ = nullptr;
+    // Edge indices and syllable ids of the path from position 0 to |pos_|.
+    std::vector<uint32_t> stack_;
+    std::vector<int16_t> syllable_ids_;
+    size_t unchanged_prefix_ = 0;
+    size_t visited_nodes_ = 0;
+    int16_t pos_ = 0;
+    uint32_t next_ = 0;
+  };
+
+  /*
+   * A lightweight view over the segmentations. It refers to the segmentor,
+   * which must outlive it and must not be modified while iterating. Starting
+   * an iteration may refresh the reachability marks, so like GetSyllableList()
+   * it is unsafe to start concurrently on one segmentor.
+   */
+  class SegmentationRange
+  {
+   public:
+    explicit SegmentationRange(const SyllableSegmentor* segmentor)
+        : segmentor_(segmentor)
+    {}
+    SegmentationIterator begin() const
+    {
+      return SegmentationIterator(segmentor_);
+    }
+    SegmentationIterator end() const { return SegmentationIterator(); }
+
+   private:
+    const SyllableSegmentor* segmentor_;
+  };
+
+  SegmentationRange Segmentations() const { return SegmentationRange(this); }
+
+  inline std::string_view translateSyllableIndex(int16_t syllable_idx) const
+  {
+    return syllable_index_->SyllableAt(syllable_idx);
   }
 
-  inline bool isEndOfSyllableStored(const Syllable* s) const
+  // Joins the syllables of a segmentation with the syllable separator.
+  std::string Render(absl::Span<const int16_t> syllable_ids) const
   {
-    return s->pos_ >= phones_[s->stored_in_phone_idx_].syllables_.size() - 1;
+    return absl::StrJoin(syllable_ids, syllable_separator_,
+                         [this](std::string* out, int16_t syllable_idx) {
+                           out->append(translateSyllableIndex(syllable_idx));
+                         });
   }
 
-  inline std::optional<const Syllable*> nextSyllableInChain(
-      const Syllable* s) const
+  /*
+   * Where a bounded enumeration stopped. Passing it back resumes with the
+   * next segmentation, as long as the segmentor has not been modified.
+   */
+  class SegmentationCursor
   {
-    if (!phones_[s->phone_idx_].syllables_.empty()) {
-      return &phones_[s->phone_idx_].syllables_.front();
-    } else {
-      return {};
+   private:
+    friend class SyllableSegmentor;
+    SegmentationCursor(const SegmentationIterator& iterator, uint64_t version)
+        : iterator_(iterator), version_(version)
+    {}
+
+    SegmentationIterator iterator_;
+    uint64_t version_;
+  };
+
+  struct EnumerationOptions
+  {
+    size_t max_results_ = std::numeric_limits<size_t>::max();
+    size_t max_visited_nodes_ = std::numeric_limits<size_t>::max();
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+  };
+
+  struct SyllableListPage
+  {
+    std::vector<std::string> syllable_lists_;
+    // Set when a budget ran out before every segmentation was rendered.
+    std::optional<SegmentationCursor> cursor_;
+  };
+
+  /*
+   * Renders segmentations until one of the budgets in |options| runs out,
+   * starting after |cursor| if given. Budgets are checked between results.
+   * Consecutive segmentations share a prefix, so one buffer is truncated to
+   * the shared part and only the new syllables are appended, keeping the cost
+   * per result proportional to its length.
+   */
+  SyllableListPage GetSyllableList(
+      const EnumerationOptions& options,
+      const SegmentationCursor* cursor = nullptr) const
+  {
+    if (cursor != nullptr && (cursor->version_ != version_ ||
+                              cursor->iterator_.segmentor_ != this)) {
+      throw std::invalid_argument("Stale segmentation cursor.");
+    }
+    SyllableListPage page;
+    // Resuming from the cursor skips the descent to the first segmentation.
+    auto iter =
+        cursor == nullptr ? Segmentations().begin() : cursor->iterator_;
+    const size_t visited_before = cursor == nullptr ? 0 : iter.visited_nodes();
+    std::string buffer;
+    // Buffer length after rendering the first i syllables.
+    std::vector<size_t> rendered_lengths{0};
+    for (; iter != Segmentations().end(); ++iter) {
+      if (page.syllable_lists_.size() >= options.max_results_ ||
+          iter.visited_nodes() - visited_before > options.max_visited_nodes_ ||
+          (options.deadline_ &&
+           std::chrono::steady_clock::now() >= *options.deadline_)) {
+        page.cursor_ = SegmentationCursor(iter, version_);
+        break;
+      }
+      const auto syllable_ids = *iter;
+      auto depth =
+          std::min(iter.unchanged_prefix(), rendered_lengths.size() - 1);
+      buffer.resize(rendered_lengths[depth]);
+      rendered_lengths.resize(depth + 1);
+      for (; depth < syllable_ids.size(); ++depth) {
+        if (depth > 0) {
+          buffer.append(syllable_separator_);
+        }
+        const auto partial = iter.partial_syllable();
+        if (partial && depth + 1 == syllable_ids.size()) {
+          buffer.append(*partial).push_back(kPartialSyllableMarker);
+        } else {
+          buffer.append(translateSyllableIndex(syllable_ids[depth]));
+        }
+        rendered_lengths.push_back(buffer.size());
+      }
+      page.syllable_lists_.push_back(buffer);
     }
+    Count(&SegmentationStats::nodes_visited_,
+          iter.visited_nodes() - visited_before);
+    CountResults(page.syllable_lists_);
+    return page;
   }
 
-  inline std::optional<const Syllable*> nextSyllable(const Syllable* s) const
+  /*
+   * Renders every segmentation. The segmentations of each prefix are cached
+   * and derived from the cached prefixes their last syllable starts at, so
+   * after a keystroke only the new last position is rendered. Inputs with
+   * more than kMaxCachedSegmentations results at some prefix fall back to
+   * depth-first enumeration. Once the cache holds more than kMaxCachedStrings
+   * strings, the prefixes too far back to be rendered from are evicted, and
+   * the cache is rebuilt if edits later need them again.
+   *
+   * The result stays valid until the next call or modification. Filling the
+   * cache makes this unsafe to call concurrently on one segmentor.
+   */
+  const std::vector<std::string>& GetSyllableList() const
   {
-    const auto& syllables = phones_[s->stored_in_phone_idx_].syllables_;
-    if (s->pos_ < syllables.size() - 1) {
-      return &syllables[s->pos_ + 1];
-    } else {
-      return {};
+    const int16_t end = size();
+    rendered_lists_.clear();
+    if (end == num_separators_) {
+      return rendered_lists_;
+    }
+    const int16_t rendered = std::min<int16_t>(prefix_lists_.size(), end);
+    if (first_cached_ > 0 &&
+        rendered - syllable_index_->max_syllable_length() < first_cached_) {
+      ResetPrefixLists();
+    }
+    while (prefix_lists_.size() <= static_cast<size_t>(end) &&
+           prefix_counts_[prefix_lists_.size()] <= kMaxCachedSegmentations) {
+      RenderPrefix(prefix_lists_.size());
     }
+    if (prefix_lists_.size() <= static_cast<size_t>(end)) {
+      rendered_lists_ =
+          std::move(GetSyllableList(EnumerationOptions()).syllable_lists_);
+      return rendered_lists_;
+    }
+    if (tail_starts_.empty()) {
+      CountResults(prefix_lists_[end]);
+      return prefix_lists_[end];
+    }
+    rendered_lists_ = prefix_lists_[end];
+    for (auto start : tail_starts_) {
+      auto tail = phones_.substr(start);
+      tail.push_back(kPartialSyllableMarker);
+      for (const auto& prefix : prefix_lists_[start]) {
+        rendered_lists_.push_back(
+            prefix.empty() ? tail
+                           : absl::StrCat(prefix, syllable_separator_, tail));
+      }
+    }
+    CountResults(rendered_lists_);
+    return rendered_lists_;
   }
 
-  inline bool isLeafSyllable(const Syllable* s) const
+  /*
+   * Segmentations as packed syllable ids in one buffer. Segmentation i is
+   * syllable_ids_[offsets_[i], offsets_[i + 1]).
+   */
+  struct SyllableIdList
   {
-    return s->phone_idx_ >= phones_.size() - 1;
+    std::vector<int16_t> syllable_ids_;
+    std::vector<uint32_t> offsets_{0};
+    // Whether the last syllable of each segmentation is partial, see
+    // EnablePartialTail().
+    std::vector<bool> partial_;
+
+    size_t size() const { return offsets_.size() - 1; }
+    absl::Span<const int16_t> operator[](size_t i) const
+    {
+      return absl::MakeConstSpan(syllable_ids_.data() + offsets_[i],
+                                 offsets_[i + 1] - offsets_[i]);
+    }
+  };
+
+  // Returns every segmentation as syllable ids, without rendering strings.
+  SyllableIdList GetSyllableIdList() const
+  {
+    SyllableIdList list;
+    const auto count = CountSegmentations();
+    if (count <= kMaxCachedSegmentations) {
+      list.offsets_.reserve(count + 1);
+    }
+    auto iter = Segmentations().begin();
+    for (; iter != Segmentations().end(); ++iter) {
+      const auto syllable_ids = *iter;
+      list.syllable_ids_.insert(list.syllable_ids_.end(), syllable_ids.begin(),
+                                syllable_ids.end());
+      list.offsets_.push_back(list.syllable_ids_.size());
+      list.partial_.push_back(iter.partial_syllable().has_value());
+    }
+    Count(&SegmentationStats::nodes_visited_, iter.visited_nodes());
+    Count(&SegmentationStats::results_emitted_, list.size());
+    Count(&SegmentationStats::bytes_allocated_,
+          list.syllable_ids_.size() * sizeof(int16_t) +
+              list.offsets_.size() * sizeof(uint32_t));
+    return list;
   }
 
-  inline std::string translateSyllableIndex(const Syllable* s) const
+  /*
+   * Counts the segmentations without enumerating them. The number of
+   * segmentations of every prefix is kept up to date as phones are appended,
+   * so this is a lookup. Saturates at UINT64_MAX.
+   */
+  uint64_t CountSegmentations() const
   {
-    if (auto r = syllable_index_->GetSyllable(s->syllable_idx_); r) {
-      return *r;
-    } else {
-      return {};
+    if (size() == num_separators_) {
+      return 0;
     }
+    const auto n = prefix_counts_.back();
+    return n > UINT64_MAX - tail_count_ ? UINT64_MAX : n + tail_count_;
   }
 
-  std::vector<std::string> GetSyllableList() const
+  struct ScoredSegmentation
   {
-    std::vector<std::string> results;
-    std::vector<const Syllable*> stack;
+    std::vector<int16_t> syllable_ids_;
+    float cost_ = 0;
+    // Whether the last syllable is partial, see EnablePartialTail().
+    bool partial_ = false;
+  };
 
-    const auto& root = phones_.front().syllables_;
-    if (root.empty()) {
+  /*
+   * Returns the |k| cheapest segmentations by the summed syllable costs,
+   * cheapest first. The cheapest cost from each position to the last one is
+   * computed backwards first. It is an exact A* heuristic, so partial paths
+   * expanded from position 0 complete in cost order and the search stops
+   * after |k| of them.
+   */
+  std::vector<ScoredSegmentation> TopK(size_t k) const
+  {
+    std::vector<ScoredSegmentation> results;
+    const int16_t end = size();
+    if (end == num_separators_ || k == 0) {
       return results;
     }
-    const Syllable* t = &root.front();
-    while (t != nullptr) {
-      std::string syllable_list =
-          absl::StrJoin(stack, syllable_separator_,
-                        [this](std::string* out, const Syllable* s) {
-                          out->append(translateSyllableIndex(s));
-                        });
-      if (auto next_syllable = nextSyllableInChain(t); next_syllable) {
-        stack.push_back(t);
-        t = *next_syllable;
-        continue;
-      } else if (isLeafSyllable(t)) {
-        auto result = syllable_list.empty()
-                          ? translateSyllableIndex(t)
-                          : absl::StrCat(syllable_list, syllable_separator_,
-                                         translateSyllableIndex(t));
-        results.push_back(std::move(result));
-        if (!stack.empty()) {
-          t = stack.back();
-          stack.pop_back();
-        }
+    const auto kUnreachable = std::numeric_limits<float>::infinity();
+    std::vector<float> best(end + 1, kUnreachable);
+    best[end] = 0;
+    for (int16_t start = end - 1; start >= 0; --start) {
+      for (auto i = edge_offsets_[start]; i < edge_offsets_[start + 1]; ++i) {
+        best[start] = std::min(
+            best[start], EdgeCost(edges_[i]) + best[start + edges_[i].length_]);
       }
-      while (!stack.empty() && !nextSyllable(t).has_value()) {
-        t = stack.back();
-        stack.pop_back();
+    }
+    if (best[0] == kUnreachable) {
+      return results;
+    }
+
+    struct PathNode
+    {
+      int32_t parent_;
+      int16_t syllable_idx_;
+      int16_t pos_;
+      float cost_;
+      bool partial_;
+    };
+    typedef std::pair<float, int32_t> QueueEntry;
+    std::vector<PathNode> nodes{{-1, -1, 0, 0, false}};
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>,
+                        std::greater<QueueEntry>>
+        queue;
+    queue.push({best[0], 0});
+    while (!queue.empty() && results.size() < k) {
+      const auto node_idx = queue.top().second;
+      queue.pop();
+      const auto node = nodes[node_idx];
+      if (node.pos_ == end) {
+        ScoredSegmentation result;
+        result.cost_ = node.cost_;
+        result.partial_ = node.partial_;
+        for (auto n = node_idx; nodes[n].parent_ >= 0; n = nodes[n].parent_) {
+          if (nodes[n].syllable_idx_ != kSeparatorEdge) {
+            result.syllable_ids_.push_back(nodes[n].syllable_idx_);
+          }
+        }
+        std::reverse(result.syllable_ids_.begin(), result.syllable_ids_.end());
+        Count(&SegmentationStats::results_emitted_, 1);
+        Count(&SegmentationStats::bytes_allocated_,
+              result.syllable_ids_.size() * sizeof(int16_t));
+        results.push_back(std::move(result));
+        continue;
       }
-      if (const auto next_syllable = nextSyllable(t); next_syllable) {
-        t = *next_syllable;
-      } else {
-        t = nullptr;
+      for (auto i = edge_offsets_[node.pos_]; i < edge_offsets_[node.pos_ + 1];
+           ++i) {
+        const int16_t next = node.pos_ + edges_[i].length_;
+        if (best[next] == kUnreachable) {
+          continue;
+        }
+        const auto cost = node.cost_ + EdgeCost(edges_[i]);
+        nodes.push_back(
+            {node_idx, edges_[i].syllable_idx_, next, cost, edges_[i].partial_});
+        queue.push({cost + best[next], static_cast<int32_t>(nodes.size() - 1)});
       }
     }
     return results;
   }
 
-  int16_t size() const { return phones_.size() - 1; }
+  int16_t size() const { return phones_.size(); }
+
+  // Removes all phones, keeping the allocated storage for reuse. Stats not
+  // yet published are added to the index.
+  void Clear()
+  {
+    PublishStats();
+    tail_starts_.clear();
+    tail_count_ = 0;
+    phones_.clear();
+    num_separators_ = 0;
+    edge_offsets_.assign(kNumRootPhoneElement + 1, 0);
+    edges_.clear();
+    incoming_lengths_.assign(kNumRootPhoneElement, 0);
+    reaches_end_.assign(kNumRootPhoneElement, true);
+    reachability_dirty_ = false;
+    prefix_counts_.assign(kNumRootPhoneElement, 1);
+    TruncatePrefixLists(kNumRootPhoneElement);
+    ++version_;
+  }
+
+  /*
+   * Inserts |phone| before the phone at |pos|, or at the end when |pos| is
+   * size(). Only the edges leaving the positions within the longest syllable
+   * before the edit are looked up again. Edges store lengths rather than end
+   * positions, so the edges after the edit stay valid as they are, but they
+   * and their offsets are still moved once, which is linear in the length.
+   */
+  void InsertPhone(int16_t pos, char phone)
+  {
+    if (pos < 0 || pos > size()) {
+      throw std::out_of_range("Trying inserting a phone out of range.");
+    }
+    if (phone <= '\0') return;
+    if (phones_.size() + 1 >= INT16_MAX) {
+      throw std::length_error("Too many phones to segment.");
+    }
+
+    // Syllables spanning position |pos| are split by the new phone, which
+    // starts an empty group of its own.
+    const int16_t lo =
+        std::max(0, pos + 1 - syllable_index_->max_syllable_length());
+    RemovePartialTail();
+    ClearIncoming(lo, pos);
+    phones_.insert(phones_.begin() + pos, ToPhone(phone));
+    num_separators_ += phones_[pos] == kPhoneSeparator;
+    edge_offsets_.insert(edge_offsets_.begin() + pos, edge_offsets_[pos]);
+    incoming_lengths_.insert(incoming_lengths_.begin() + pos + 1, 0);
+    RebuildGroups(lo, pos + 1);
+    RefreshFrom(pos);
+  }
+
+  // Erases the phone at |pos|, repairing the lattice around it like
+  // InsertPhone.
+  void ErasePhone(int16_t pos)
+  {
+    if (pos < 0 || pos >= size()) {
+      throw std::out_of_range("Trying erasing a phone out of range.");
+    }
+
+    // Syllables holding the phone go, then positions |pos| and |pos| + 1
+    // merge, and the group of the merged position is looked up again too.
+    const int16_t lo =
+        std::max(0, pos + 1 - syllable_index_->max_syllable_length());
+    RemovePartialTail();
+    ClearIncoming(lo, pos + 2);
+    num_separators_ -= phones_[pos] == kPhoneSeparator;
+    phones_.erase(phones_.begin() + pos);
+    edge_offsets_.erase(edge_offsets_.begin() + pos + 1);
+    incoming_lengths_.erase(incoming_lengths_.begin() + pos + 1);
+    RebuildGroups(lo, pos + 1);
+    RefreshFrom(pos);
+  }
 
   void PopLastPhone()
   {
-    if (phones_.size() <= 1) {
+    if (phones_.empty()) {
       throw std::out_of_range("Trying poping phones when no phone is stored.");
     }
-    auto last_phone_idx = phones_.size() - 1;
+    RemovePartialTail();
+    const int16_t end = size();
+    const auto incoming = incoming_lengths_.back();
+    num_separators_ -= phones_.back() == kPhoneSeparator;
     phones_.pop_back();
-    for (auto& p : phones_) {
-      auto& s = p.syllables_;
-      while (!s.empty() && s.back().phone_idx_ == last_phone_idx) {
-        s.pop_back();
+    incoming_lengths_.pop_back();
+    prefix_counts_.pop_back();
+    TruncatePrefixLists(end);
+
+    // Edges ending at |end| are the last of their groups, and only groups
+    // within the longest incoming edge are touched.
+    int16_t first_start = end;
+    for (auto lengths = incoming; lengths != 0; lengths >>= 1) {
+      --first_start;
+    }
+    uint32_t kept = edge_offsets_[first_start];
+    for (int16_t start = first_start; start < end; ++start) {
+      auto last = edge_offsets_[start + 1];
+      if (incoming & (1u << (end - start - 1))) {
+        --last;
+      }
+      const auto first = edge_offsets_[start];
+      edge_offsets_[start] = kept;
+      for (auto i = first; i < last; ++i) {
+        edges_[kept++] = edges_[i];
       }
     }
+    edges_.erase(edges_.begin() + kept, edges_.end());
+    edge_offsets_.pop_back();
+    edge_offsets_.back() = kept;
+    AddPartialTail();
+    reachability_dirty_ = true;
+    ++version_;
   }
 
  private:
-  std::vector<Phone> phones_;
+  // Adds the lattice position |end| and the edges ending there. Phones after
+  // |end| may already be stored and are not looked at.
+  void ExtendLattice(int16_t end)
+  {
+    edge_offsets_.push_back(edges_.size());
+    incoming_lengths_.push_back(0);
+    const auto max_look_back = syllable_index_->MaxLookBack(phones_[end - 1]);
+    uint64_t count = 0;
+    if (phones_[end - 1] == kPhoneSeparator) {
+      InsertEdge(end - 1, Edge(1, kSeparatorEdge));
+      incoming_lengths_.back() = 1;
+      count = prefix_counts_[end - 1];
+    }
+    auto walker = syllable_index_->ReverseWalk();
+    for (int16_t start = end - 1; start >= 0 && end - start <= max_look_back;
+         --start) {
+      Count(&SegmentationStats::index_probes_, 1);
+      if (!walker.Step(phones_[start])) {
+        break;
+      }
+      if (auto syllable_idx = walker.syllable_idx(); syllable_idx) {
+        Count(&SegmentationStats::index_hits_, 1);
+        InsertEdge(start, Edge(end - start, *syllable_idx));
+        incoming_lengths_.back() |= 1u << (end - start - 1);
+        const auto n = prefix_counts_[start];
+        count = n > UINT64_MAX - count ? UINT64_MAX : count + n;
+      }
+    }
+    prefix_counts_.push_back(count);
+  }
+
+  // Renders the segmentations of the first |end| phones from the cached
+  // segmentations of the positions its incoming edges start at.
+  void RenderPrefix(int16_t end) const
+  {
+    std::vector<std::string> lists;
+    lists.reserve(prefix_counts_[end]);
+    int16_t start = end - 1;
+    for (auto lengths = incoming_lengths_[end]; lengths != 0;
+         lengths >>= 1, --start) {
+      if ((lengths & 1) == 0) {
+        continue;
+      }
+      auto edge = edge_offsets_[start];
+      while (start + edges_[edge].length_ != end) {
+        ++edge;
+      }
+      if (edges_[edge].syllable_idx_ == kSeparatorEdge) {
+        lists.insert(lists.end(), prefix_lists_[start].begin(),
+                     prefix_lists_[start].end());
+        continue;
+      }
+      const auto syllable = translateSyllableIndex(edges_[edge].syllable_idx_);
+      for (const auto& prefix : prefix_lists_[start]) {
+        std::string list;
+        if (!prefix.empty()) {
+          list.reserve(prefix.size() + syllable_separator_.size() +
+                       syllable.size());
+          list.append(prefix).append(syllable_separator_);
+        }
+        lists.push_back(std::move(list.append(syllable)));
+      }
+    }
+    cached_strings_ += lists.size();
+    prefix_lists_.push_back(std::move(lists));
+
+    // Positions after |end| render from at most max_syllable_length() back.
+    const int16_t needed = end + 1 - syllable_index_->max_syllable_length();
+    while (cached_strings_ > kMaxCachedStrings && first_cached_ < needed) {
+      cached_strings_ -= prefix_lists_[first_cached_].size();
+      std::vector<std::string>().swap(prefix_lists_[first_cached_]);
+      ++first_cached_;
+    }
+  }
+
+  // Drops the cached segmentations of the prefixes longer than |size| - 1.
+  void TruncatePrefixLists(size_t size) const
+  {
+    while (prefix_lists_.size() > size) {
+      cached_strings_ -= prefix_lists_.back().size();
+      prefix_lists_.pop_back();
+    }
+    if (first_cached_ > 0 &&
+        prefix_lists_.size() <= static_cast<size_t>(first_cached_)) {
+      ResetPrefixLists();
+    }
+  }
+
+  void ResetPrefixLists() const
+  {
+    prefix_lists_.assign(kNumRootPhoneElement, {std::string()});
+    cached_strings_ = kNumRootPhoneElement;
+    first_cached_ = 0;
+  }
+  void ExtendLattice() { ExtendLattice(size()); }
+
+  // Normalizes a single phone like AppendPhones() does, lowercasing it and
+  // storing the syllable separator like an apostrophe. Other bytes are kept
+  // as they are and spell no syllable.
+  char ToPhone(char phone) const
+  {
+    char normalized;
+    return NormalizePhones(std::string_view(&phone, 1), &normalized,
+                           syllable_separator_[0])
+               ? normalized
+               : phone;
+  }
+
+  float EdgeCost(const Edge& edge) const
+  {
+    return edge.syllable_idx_ == kSeparatorEdge
+               ? 0
+               : syllable_index_->GetCost(edge.syllable_idx_);
+  }
+
+  /*
+   * Marks the positions the last position can be reached from, sweeping the
+   * incoming edge bitmasks backwards. It only reads one word per position, so
+   * enumeration never has to enter a dead end to find out. Edits only mark
+   * the marks stale, and the sweep runs before the next enumeration, which
+   * is linear in the phones anyway, so keystrokes stay local.
+   */
+  void UpdateReachability() const
+  {
+    if (!reachability_dirty_) {
+      return;
+    }
+    reachability_dirty_ = false;
+    const int16_t end = size();
+    reaches_end_.assign(end + 1, false);
+    reaches_end_[end] = true;
+    for (auto start : tail_starts_) {
+      reaches_end_[start] = true;
+    }
+    for (int16_t pos = end; pos > 0; --pos) {
+      if (!reaches_end_[pos]) {
+        continue;
+      }
+      int16_t start = pos - 1;
+      for (auto lengths = incoming_lengths_[pos]; lengths != 0;
+           lengths >>= 1, --start) {
+        if (lengths & 1) {
+          reaches_end_[start] = true;
+        }
+      }
+    }
+  }
+
+  // Clears the incoming lengths of the edges leaving the positions in
+  // [|lo|, |hi|).
+  void ClearIncoming(int16_t lo, int16_t hi)
+  {
+    for (auto start = lo; start < hi; ++start) {
+      for (auto i = edge_offsets_[start]; i < edge_offsets_[start + 1]; ++i) {
+        incoming_lengths_[start + edges_[i].length_] &=
+            ~(1u << (edges_[i].length_ - 1));
+      }
+    }
+  }
+
+  /*
+   * Replaces the edges leaving the positions in [|lo|, |hi|) by the ones the
+   * phones spell now, walking back from each end in ascending order so that
+   * every group stays sorted by length. The edges and offsets after the
+   * window are moved once, by the difference in the number of edges.
+   */
+  void RebuildGroups(int16_t lo, int16_t hi)
+  {
+    std::vector<std::pair<int16_t, Edge>> found;
+    const int16_t max_length = syllable_index_->max_syllable_length();
+    for (int16_t end = lo + 1; end <= size() && end - max_length < hi;
+         ++end) {
+      if (phones_[end - 1] == kPhoneSeparator && end - 1 < hi) {
+        found.push_back({end - 1, Edge(1, kSeparatorEdge)});
+      }
+      const auto max_look_back =
+          syllable_index_->MaxLookBack(phones_[end - 1]);
+      auto walker = syllable_index_->ReverseWalk();
+      for (int16_t start = end - 1;
+           start >= lo && end - start <= max_look_back; --start) {
+        Count(&SegmentationStats::index_probes_, 1);
+        if (!walker.Step(phones_[start])) {
+          break;
+        }
+        if (start >= hi) {
+          continue;
+        }
+        if (auto syllable_idx = walker.syllable_idx(); syllable_idx) {
+          Count(&SegmentationStats::index_hits_, 1);
+          found.push_back({start, Edge(end - start, *syllable_idx)});
+        }
+      }
+    }
+    std::stable_sort(found.begin(), found.end(),
+                     [](const auto& a, const auto& b) {
+                       return a.first < b.first;
+                     });
+    Count(&SegmentationStats::edges_added_, found.size());
+
+    const auto first = edge_offsets_[lo];
+    const auto last = edge_offsets_[hi];
+    if (found.size() > last - first) {
+      edges_.insert(edges_.begin() + last, found.size() - (last - first),
+                    Edge(1, kSeparatorEdge));
+    } else {
+      edges_.erase(edges_.begin() + first + found.size(),
+                   edges_.begin() + last);
+    }
+    for (size_t i = 0; i < found.size(); ++i) {
+      const auto& [start, edge] = found[i];
+      edges_[first + i] = edge;
+      incoming_lengths_[start + edge.length_] |= 1u << (edge.length_ - 1);
+    }
+    auto next = found.begin();
+    for (auto pos = lo + 1; pos <= hi; ++pos) {
+      while (next != found.end() && next->first < pos) {
+        ++next;
+      }
+      edge_offsets_[pos] = first + (next - found.begin());
+    }
+    const uint32_t shifted = edge_offsets_[hi] - last;
+    for (size_t pos = hi + 1; pos < edge_offsets_.size(); ++pos) {
+      edge_offsets_[pos] += shifted;
+    }
+  }
+
+  // Recomputes what is derived from the lattice after an edit at |pos|.
+  // Nothing ending at or before |pos| has changed.
+  void RefreshFrom(int16_t pos)
+  {
+    prefix_counts_.resize(pos + 1);
+    for (int16_t end = pos + 1; end <= size(); ++end) {
+      uint64_t count = 0;
+      int16_t start = end - 1;
+      for (auto lengths = incoming_lengths_[end]; lengths != 0;
+           lengths >>= 1, --start) {
+        if (lengths & 1) {
+          const auto n = prefix_counts_[start];
+          count = n > UINT64_MAX - count ? UINT64_MAX : count + n;
+        }
+      }
+      prefix_counts_.push_back(count);
+    }
+    TruncatePrefixLists(pos + 1);
+    AddPartialTail();
+    reachability_dirty_ = true;
+    ++version_;
+  }
+
+  // Adds the partial edges ending at the last position if enabled. They are
+  // left out of the incoming lengths, so the lattice before the last
+  // position stays as if they did not exist.
+  void AddPartialTail()
+  {
+    if (!partial_tail_) {
+      return;
+    }
+    const int16_t end = size();
+    auto walker = syllable_index_->PartialWalk();
+    for (int16_t start = end - 1;
+         start >= 0 && end - start < syllable_index_->max_syllable_length();
+         --start) {
+      Count(&SegmentationStats::index_probes_, 1);
+      if (!walker.Step(phones_[start])) {
+        break;
+      }
+      if (auto syllable_idx = walker.syllable_idx(); syllable_idx) {
+        Count(&SegmentationStats::index_hits_, 1);
+        InsertEdge(start, Edge(end - start, *syllable_idx, true));
+        tail_starts_.push_back(start);
+        const auto n = prefix_counts_[start];
+        tail_count_ = n > UINT64_MAX - tail_count_ ? UINT64_MAX : tail_count_ + n;
+      }
+    }
+  }
+
+  // Partial edges end at the last position, so they are the last edges of
+  // their groups, which are compacted in one pass like in PopLastPhone().
+  void RemovePartialTail()
+  {
+    if (tail_starts_.empty()) {
+      return;
+    }
+    const int16_t end = size();
+    // Starts were added walking backwards.
+    auto tail = tail_starts_.rbegin();
+    uint32_t kept = edge_offsets_[*tail];
+    for (int16_t start = *tail; start < end; ++start) {
+      auto last = edge_offsets_[start + 1];
+      if (tail != tail_starts_.rend() && *tail == start) {
+        --last;
+        ++tail;
+      }
+      const auto first = edge_offsets_[start];
+      edge_offsets_[start] = kept;
+      for (auto i = first; i < last; ++i) {
+        edges_[kept++] = edges_[i];
+      }
+    }
+    edges_.erase(edges_.begin() + kept, edges_.end());
+    std::fill(edge_offsets_.begin() + end, edge_offsets_.end(), kept);
+    tail_starts_.clear();
+    tail_count_ = 0;
+  }
+
+  void CountResults(const std::vector<std::string>& lists) const
+  {
+    if constexpr (kEnableStats) {
+      Count(&SegmentationStats::results_emitted_, lists.size());
+      for (const auto& list : lists) {
+        Count(&SegmentationStats::bytes_allocated_, list.size());
+      }
+    }
+  }
+
+  // Edges leaving |start| are kept in ascending length, and a new edge always
+  // ends after the existing ones, so it goes to the back of its group. Only
+  // used near the last position, where few edges and offsets follow.
+  void InsertEdge(int16_t start, Edge edge)
+  {
+    Count(&SegmentationStats::edges_added_, 1);
+    edges_.insert(edges_.begin() + edge_offsets_[start + 1], edge);
+    for (size_t p = start + 1; p < edge_offsets_.size(); ++p) {
+      ++edge_offsets_[p];
+    }
+  }
+
+  std::string phones_;
+  // Phones which are separators. A segmentation has at least one syllable,
+  // so phones that are all separators have none.
+  int16_t num_separators_ = 0;
+  std::vector<uint32_t> edge_offsets_;
+  std::vector<Edge> edges_;
+  // Bit i is set when an edge of length i + 1 ends at the position.
+  std::vector<uint32_t> incoming_lengths_;
+  // Stale while |reachability_dirty_|, see UpdateReachability().
+  mutable std::vector<bool> reaches_end_;
+  mutable bool reachability_dirty_ = false;
+  // Number of segmentations of the first p phones, saturating.
+  std::vector<uint64_t> prefix_counts_;
+  // Rendered segmentations of the first p phones, filled on demand. Those
+  // before |first_cached_| are evicted, see kMaxCachedStrings.
+  mutable std::vector<std::vector<std::string>> prefix_lists_;
+  mutable size_t cached_strings_ = kNumRootPhoneElement;
+  mutable int16_t first_cached_ = 0;
+  // Returned by GetSyllableList() when not a cached list itself.
+  mutable std::vector<std::string> rendered_lists_;
+  // Bumped on every modification to invalidate cursors.
+  uint64_t version_ = 0;
+  bool partial_tail_ = false;
+  // Starts of the partial edges, and the segmentations ending with them.
+  std::vector<int16_t> tail_starts_;
+  uint64_t tail_count_ = 0;
   std::shared_ptr<SyllableIndex> syllable_index_;
   std::string syllable_separator_;
 };
 
+struct SegmentBatchOptions
+{
+  // Zero uses one thread per hardware thread.
+  size_t num_threads_ = 0;
+  char syllable_separator_ = kDefaultPinYinSyllableSeparator;
+};
+
+/*
+ * Segments every input with a pool of threads sharing |syllable_index|, and
+ * returns the syllable lists in input order. Each thread owns a segmentor
+ * and a queue of inputs. A thread whose queue runs dry steals from the back
+ * of another queue, since segmentation cost varies a lot between inputs.
+ */
+inline std::vector<std::vector<std::string>> SegmentBatch(
+    const std::shared_ptr<SyllableIndex>& syllable_index,
+    absl::Span<const std::string_view> inputs,
+    const SegmentBatchOptions& options = {})
+{
+  std::vector<std::vector<std::string>> results(inputs.size());
+  auto num_threads = options.num_threads_ > 0
+                         ? options.num_threads_
+                         : std::max(1u, std::thread::hardware_concurrency());
+  num_threads = std::max<size_t>(1, std::min(num_threads, inputs.size()));
+
+  struct WorkQueue
+  {
+    std::mutex mutex_;
+    std::deque<size_t> inputs_;
+  };
+  std::vector<WorkQueue> queues(num_threads);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    queues[i * num_threads / inputs.size()].inputs_.push_back(i);
+  }
+
+  auto take = [&queues, num_threads](size_t worker) -> std::optional<size_t> {
+    for (size_t k = 0; k < num_threads; ++k) {
+      auto& queue = queues[(worker + k) % num_threads];
+      std::lock_guard<std::mutex> lock(queue.mutex_);
+      if (!queue.inputs_.empty()) {
+        size_t input;
+        if (k == 0) {
+          input = queue.inputs_.front();
+          queue.inputs_.pop_front();
+        } else {
+          input = queue.inputs_.back();
+          queue.inputs_.pop_back();
+        }
+        return {input};
+      }
+    }
+    return {};
+  };
+
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto work = [&](size_t worker) {
+    try {
+      SyllableSegmentor segmentor(syllable_index,
+                                  options.syllable_separator_);
+      while (auto input = take(worker)) {
+        segmentor.Clear();
+        for (auto phone : inputs[*input]) {
+          segmentor.AppendPhone(phone);
+        }
+        results[*input] = segmentor.GetSyllableList();
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t worker = 1; worker < num_threads; ++worker) {
+    threads.emplace_back(work, worker);
+  }
+  work(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return results;
+}
+
 };  // namespace epinyin
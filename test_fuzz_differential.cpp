@@ -0,0 +1,264 @@
+// Differential fuzz target. Fuzz bytes are read as a syllable separator and
+// a sequence of edits and queries, which run against a SyllableSegmentor and
+// a brute-force reference segmenter, and every query must agree on the
+// segmentations.
+
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <stdexcept>
+
+#include "syllable_segmentation.hpp"
+
+namespace {
+
+using namespace epinyin;
+
+// Keeps the reference enumeration small, it is exponential in the length.
+const size_t kMaxPhones = 20;
+const size_t kMaxRunLength = 8;
+// The syllable separator is one more phone after these.
+const char kPhones[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ'";
+const char kSeparators[] = "`-_";
+
+enum Op {
+  kAppend,
+  kAppendRun,
+  kPop,
+  kInsert,
+  kErase,
+  kClear,
+  kQuery,
+  kTogglePartialTail,
+  kNumOps
+};
+
+char ToPhone(uint8_t arg, char separator)
+{
+  arg %= sizeof(kPhones);
+  return arg == sizeof(kPhones) - 1 ? separator : kPhones[arg];
+}
+
+// The reference sees phones lowercased and every separator as an apostrophe.
+char ToReferencePhone(char phone, char separator)
+{
+  if (phone == separator) {
+    return '\'';
+  }
+  return phone >= 'A' && phone <= 'Z' ? phone - 'A' + 'a' : phone;
+}
+
+bool IsSeparator(char phone) { return phone == '\''; }
+
+class ReferenceSegmenter
+{
+ public:
+  explicit ReferenceSegmenter(const SyllableIndex& index)
+  {
+    for (int16_t idx = 0; idx < index.size(); ++idx) {
+      const auto syllable = std::string(index.SyllableAt(idx));
+      syllables_.insert(syllable);
+      for (size_t length = 1; length < syllable.size(); ++length) {
+        prefixes_.insert(syllable.substr(0, length));
+      }
+    }
+  }
+
+  // Every split of |phones| into syllables by trying each length, skipping
+  // separators, joined by |separator| and sorted.
+  std::vector<std::string> Segment(const std::string& phones,
+                                   bool partial_tail, char separator) const
+  {
+    std::vector<std::string> lists;
+    if (!phones.empty()) {
+      Segment(phones, 0, partial_tail, separator, "", &lists);
+    }
+    std::sort(lists.begin(), lists.end());
+    return lists;
+  }
+
+ private:
+  void Segment(const std::string& phones, size_t pos, bool partial_tail,
+               char separator, const std::string& list,
+               std::vector<std::string>* lists) const
+  {
+    if (pos == phones.size()) {
+      // Separators alone are no segmentation.
+      if (!list.empty()) {
+        lists->push_back(list);
+      }
+      return;
+    }
+    if (IsSeparator(phones[pos])) {
+      Segment(phones, pos + 1, partial_tail, separator, list, lists);
+      return;
+    }
+    auto join = [&list, separator](const std::string& syllable) {
+      return list.empty() ? syllable : list + separator + syllable;
+    };
+    for (auto end = pos + 1; end <= phones.size(); ++end) {
+      if (IsSeparator(phones[end - 1])) {
+        break;
+      }
+      const auto syllable = phones.substr(pos, end - pos);
+      if (syllables_.count(syllable)) {
+        Segment(phones, end, partial_tail, separator, join(syllable), lists);
+      } else if (partial_tail && end == phones.size() &&
+                 prefixes_.count(syllable)) {
+        lists->push_back(join(syllable + kPartialSyllableMarker));
+      }
+    }
+  }
+
+  std::set<std::string> syllables_;
+  std::set<std::string> prefixes_;
+};
+
+void Check(bool ok)
+{
+  if (!ok) {
+    abort();
+  }
+}
+
+// Renders syllable ids like GetSyllableList(): a partial last syllable is
+// the phones left after the others, followed by kPartialSyllableMarker.
+std::string Render(const SyllableIndex& index, const std::string& phones,
+                   char separator, absl::Span<const int16_t> syllable_ids,
+                   bool partial)
+{
+  std::string list;
+  size_t pos = 0;
+  for (size_t i = 0; i < syllable_ids.size(); ++i) {
+    while (IsSeparator(phones[pos])) {
+      ++pos;
+    }
+    if (!list.empty()) {
+      list.push_back(separator);
+    }
+    if (partial && i + 1 == syllable_ids.size()) {
+      list.append(phones.substr(pos)).push_back(kPartialSyllableMarker);
+    } else {
+      const auto syllable = index.SyllableAt(syllable_ids[i]);
+      list.append(syllable.data(), syllable.size());
+      pos += syllable.size();
+    }
+  }
+  return list;
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* Data, size_t Size) {
+  static auto index = SyllableIndex::CreateShared("syllable_list.csv");
+  static const ReferenceSegmenter reference(*index);
+  if (Size == 0) {
+    return 0;
+  }
+  const char separator = kSeparators[Data[0] % (sizeof(kSeparators) - 1)];
+  SyllableSegmentor s(index, separator);
+  std::string phones;
+  bool partial_tail = false;
+
+  for (size_t i = 1; i < Size; ++i) {
+    const auto op = Data[i] % kNumOps;
+    const uint8_t arg = i + 1 < Size ? Data[++i] : 0;
+    const char phone = ToPhone(arg, separator);
+    const int16_t pos = phones.empty() ? 0 : arg % (phones.size() + 1);
+    switch (op) {
+      case kAppend:
+        if (phones.size() < kMaxPhones) {
+          s.AppendPhone(phone);
+          phones.push_back(ToReferencePhone(phone, separator));
+        }
+        break;
+      case kAppendRun: {
+        // The high bit of |arg| ends the run with an invalid phone.
+        std::string run;
+        for (size_t j = arg % kMaxRunLength; j > 0 && i + 1 < Size; --j) {
+          run.push_back(ToPhone(Data[++i], separator));
+        }
+        const bool valid = !(arg & 0x80);
+        if (!valid) {
+          run.push_back('1');
+        }
+        if (phones.size() + run.size() > kMaxPhones) {
+          break;
+        }
+        try {
+          s.AppendPhones(run);
+          Check(valid);
+        } catch (const std::invalid_argument&) {
+          Check(!valid);
+          break;
+        }
+        for (auto c : run) {
+          phones.push_back(ToReferencePhone(c, separator));
+        }
+        break;
+      }
+      case kPop:
+        if (!phones.empty()) {
+          s.PopLastPhone();
+          phones.pop_back();
+        }
+        break;
+      case kInsert:
+        if (phones.size() < kMaxPhones) {
+          s.InsertPhone(pos, phone);
+          phones.insert(phones.begin() + pos,
+                        ToReferencePhone(phone, separator));
+        }
+        break;
+      case kErase:
+        if (static_cast<size_t>(pos) < phones.size()) {
+          s.ErasePhone(pos);
+          phones.erase(phones.begin() + pos);
+        }
+        break;
+      case kClear:
+        s.Clear();
+        phones.clear();
+        break;
+      case kTogglePartialTail:
+        partial_tail = !partial_tail;
+        s.EnablePartialTail(partial_tail);
+        break;
+      case kQuery: {
+        const auto expected = reference.Segment(phones, partial_tail, separator);
+        auto lists = s.GetSyllableList();
+        std::sort(lists.begin(), lists.end());
+        Check(lists == expected);
+        auto page = s.GetSyllableList(SyllableSegmentor::EnumerationOptions());
+        std::sort(page.syllable_lists_.begin(), page.syllable_lists_.end());
+        Check(page.syllable_lists_ == expected);
+        Check(s.CountSegmentations() == expected.size());
+
+        const auto ids = s.GetSyllableIdList();
+        std::vector<std::string> rendered;
+        for (size_t j = 0; j < ids.size(); ++j) {
+          rendered.push_back(
+              Render(*index, phones, separator, ids[j], ids.partial_[j]));
+        }
+        std::sort(rendered.begin(), rendered.end());
+        Check(rendered == expected);
+
+        // Every segmentation, cheapest first.
+        const auto top = s.TopK(SIZE_MAX);
+        rendered.clear();
+        for (size_t j = 0; j < top.size(); ++j) {
+          Check(j == 0 || top[j - 1].cost_ <= top[j].cost_);
+          rendered.push_back(Render(*index, phones, separator,
+                                    top[j].syllable_ids_, top[j].partial_));
+        }
+        std::sort(rendered.begin(), rendered.end());
+        Check(rendered == expected);
+        break;
+      }
+    }
+    Check(static_cast<size_t>(s.size()) == phones.size());
+  }
+
+  return 0;  // Non-zero return values are reserved for future use.
+}
@@ -0,0 +1,41 @@
+// Stats are compiled in for this suite only, so epinyin_test covers the
+// default build where they are disabled.
+
+#define CATCH_CONFIG_MAIN
+#define EPINYIN_ENABLE_STATS 1
+
+#include "catch.hpp"
+#include "syllable_segmentation.hpp"
+
+namespace epinyin {
+
+using namespace std;
+
+TEST_CASE("Stats count the work per segmentor and per index",
+          "[integration]")
+{
+  auto syllable_index = SyllableIndex::CreateShared("syllable_list.csv");
+  {
+    SyllableSegmentor s(syllable_index);
+    s.AppendPhones("xiangang");
+    REQUIRE(s.stats().index_probes_ > 0);
+    REQUIRE(s.stats().index_hits_ == s.stats().edges_added_);
+    REQUIRE(s.stats().results_emitted_ == 0);
+
+    auto l = s.GetSyllableList();
+    REQUIRE(s.stats().results_emitted_ == l.size());
+    auto page = s.GetSyllableList(SyllableSegmentor::EnumerationOptions());
+    REQUIRE(s.stats().results_emitted_ == 2 * l.size());
+    REQUIRE(s.stats().nodes_visited_ >= l.size());
+    REQUIRE(s.stats().bytes_allocated_ > 0);
+    REQUIRE(syllable_index->stats().results_emitted_ == 0);
+
+    s.Clear();
+    REQUIRE(syllable_index->stats().results_emitted_ == 2 * l.size());
+    s.AppendPhone('a');
+  }
+  REQUIRE(syllable_index->stats().edges_added_ > 0);
+  REQUIRE(syllable_index->stats().index_probes_ > 0);
+}
+
+};  // namespace epinyin
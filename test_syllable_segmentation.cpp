@@ -4,10 +4,18 @@
 
 #define CATCH_CONFIG_MAIN
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <memory>
+#include <type_traits>
 
 #include "catch.hpp"
 #include "syllable_segmentation.hpp"
+#include "syllable_table.hpp"
 
 namespace epinyin {
 
@@ -18,6 +26,113 @@ TEST_CASE("SyllableIndex loads the syllables")
 {
   auto s = SyllableIndex::CreateShared("syllable_list.csv");
   REQUIRE(s->GetIndex("fa") > 0);
+  REQUIRE(s->GetSyllable(*s->GetIndex("fa")) == "fa");
+  REQUIRE_FALSE(s->GetIndex("fangx").has_value());
+  REQUIRE_FALSE(s->GetIndex("").has_value());
+  REQUIRE_FALSE(s->GetSyllable(s->size()).has_value());
+}
+
+TEST_CASE("SyllableIndex walks syllables from their last phone")
+{
+  auto s = SyllableIndex::CreateShared("syllable_list.csv");
+  auto walker = s->ReverseWalk();
+  REQUIRE(walker.Step('g'));
+  REQUIRE(walker.Step('n'));
+  REQUIRE_FALSE(walker.syllable_idx().has_value());
+  REQUIRE(walker.Step('a'));
+  REQUIRE(walker.syllable_idx() == s->GetIndex("ang"));
+  REQUIRE(walker.Step('i'));
+  REQUIRE(walker.Step('x'));
+  REQUIRE(walker.syllable_idx() == s->GetIndex("xiang"));
+  REQUIRE_FALSE(walker.Step('q'));
+}
+
+TEST_CASE("SyllableIndex completes partial syllables")
+{
+  auto s = SyllableIndex::CreateShared("syllable_list.csv");
+  auto walker = s->PartialWalk();
+  REQUIRE(walker.Step('h'));
+  REQUIRE(walker.Step('z'));
+  REQUIRE(walker.syllable_idx() == s->GetIndex("zhe"));
+
+  // Every prefix ending with 'i' is a syllable on its own.
+  REQUIRE_FALSE(s->PartialWalk().Step('i'));
+}
+
+TEST_CASE("Embedded syllable table matches the dict file")
+{
+  auto s = SyllableIndex::CreateShared("syllable_list.csv");
+  auto embedded_index = CreateEmbeddedSyllableIndex();
+  REQUIRE(embedded_index->size() == s->size());
+  for (size_t i = 0; i < embedded::kNumSyllables; ++i) {
+    const auto syllable = s->SyllableAt(i);
+    REQUIRE(embedded_index->SyllableAt(i) == syllable);
+    REQUIRE(embedded_index->GetIndex(syllable) == i);
+    REQUIRE(embedded_index->GetCost(i) == s->GetCost(i));
+  }
+  REQUIRE(embedded_index->max_syllable_length() == s->max_syllable_length());
+  REQUIRE(embedded_index->MaxLookBack('g') == s->MaxLookBack('g'));
+  REQUIRE(embedded_index->GetIndex("zhuanq") < 0);
+  auto walker = embedded_index->PartialWalk();
+  REQUIRE(walker.Step('h'));
+  REQUIRE(walker.Step('z'));
+  REQUIRE(walker.syllable_idx() == s->GetIndex("zhe"));
+  REQUIRE_FALSE(embedded_index->GetIndex("").has_value());
+}
+
+TEST_CASE("SyllableIndex knows the syllable lengths")
+{
+  auto s = SyllableIndex::CreateShared("syllable_list.csv");
+  REQUIRE(s->min_syllable_length() == 1);
+  REQUIRE(s->max_syllable_length() == 6);
+  REQUIRE(s->MaxLookBack('g') == 6);
+  REQUIRE(s->MaxLookBack('v') == 0);
+  REQUIRE(s->MaxLookBack('\'') == 0);
+}
+
+TEST_CASE("SyllableIndex serves lookups from a mapped index file")
+{
+  auto s = SyllableIndex::CreateShared("syllable_list.csv");
+  const string path = "test_syllable_index.bin";
+  s->Save(path);
+  auto mapped = SyllableIndex::OpenMapped(path);
+  REQUIRE(mapped->size() == s->size());
+  REQUIRE(mapped->max_syllable_length() == s->max_syllable_length());
+  for (int16_t i = 0; i < s->size(); ++i) {
+    REQUIRE(mapped->SyllableAt(i) == s->SyllableAt(i));
+    REQUIRE(mapped->GetIndex(s->SyllableAt(i)) == i);
+    REQUIRE(mapped->GetCost(i) == s->GetCost(i));
+  }
+  auto walker = mapped->PartialWalk();
+  REQUIRE(walker.Step('h'));
+  REQUIRE(walker.Step('z'));
+  REQUIRE(walker.syllable_idx() == s->GetIndex("zhe"));
+
+  SyllableSegmentor segmentor(mapped);
+  for (auto c : string("xiangang")) {
+    segmentor.AppendPhone(c);
+  }
+  CHECK_THAT(segmentor.GetSyllableList(),
+             VectorContains(string("xian`gang")));
+
+  // A header whose longest syllable is shorter than its trie walks.
+  string bytes;
+  {
+    ifstream fin(path, ios::binary);
+    bytes.assign(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+  }
+  const int16_t short_max_length = 2;
+  memcpy(&bytes[offsetof(IndexFileHeader, max_syllable_length_)],
+         &short_max_length, sizeof(short_max_length));
+  const string corrupt_path = "test_syllable_index_corrupt.bin";
+  ofstream(corrupt_path, ios::binary | ios::trunc) << bytes;
+  REQUIRE_THROWS_AS(SyllableIndex::OpenMapped(corrupt_path), invalid_argument);
+  remove(corrupt_path.c_str());
+
+  ofstream(path, ios::binary | ios::trunc) << "EPYI";
+  REQUIRE_THROWS_AS(SyllableIndex::OpenMapped(path), invalid_argument);
+  remove(path.c_str());
+  REQUIRE_THROWS_AS(SyllableIndex::OpenMapped(path), invalid_argument);
 }
 
 class SyllableSegmentorFixture
@@ -74,6 +189,267 @@ TEST_CASE_METHOD(SyllableSegmentorFixture,
     CHECK_THAT(l, VectorContains(string("xiang`ang")));
     CHECK_THAT(l, VectorContains(string("xi`ang`ang")));
   }
+
+  string test3 = "zhuangshuang";
+  SECTION("input " + test3)
+  {
+    SyllableSegmentor s(syllable_index_);
+    for (auto c : test3) {
+      s.AppendPhone(c);
+    }
+    auto l = s.GetSyllableList();
+    CHECK_THAT(l, VectorContains(string("zhuang`shuang")));
+    CHECK_THAT(l, VectorContains(string("zhu`ang`shu`ang")));
+  }
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "Segmentations yields syllable ids lazily", "[unit]")
+{
+  SyllableSegmentor s(syllable_index_);
+  REQUIRE(s.Segmentations().begin() == s.Segmentations().end());
+  for (auto c : "xiangang") {
+    s.AppendPhone(c);
+  }
+  auto l = s.GetSyllableList();
+  auto iter = s.Segmentations().begin();
+  REQUIRE(iter != s.Segmentations().end());
+  CHECK_THAT(l, VectorContains(s.Render(*iter)));
+  auto first = *iter;
+  REQUIRE(first.size() == 3);
+  REQUIRE(first[0] == syllable_index_->GetIndex("xi"));
+  REQUIRE(std::distance(s.Segmentations().begin(), s.Segmentations().end()) ==
+          l.size());
+  for (auto syllable_ids : s.Segmentations()) {
+    CHECK_THAT(l, VectorContains(s.Render(syllable_ids)));
+  }
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "GetSyllableList pages through results with a cursor",
+                 "[unit]")
+{
+  SyllableSegmentor s(syllable_index_);
+  s.AppendPhones("xianxianxianxianxian");
+  const auto all = s.GetSyllableList();
+  REQUIRE(all.size() == 32);
+
+  SyllableSegmentor::EnumerationOptions options;
+  options.max_results_ = 5;
+  vector<string> paged;
+  auto page = s.GetSyllableList(options);
+  while (true) {
+    REQUIRE(page.syllable_lists_.size() <= 5);
+    paged.insert(paged.end(), page.syllable_lists_.begin(),
+                 page.syllable_lists_.end());
+    if (!page.cursor_) {
+      break;
+    }
+    page = s.GetSyllableList(options, &*page.cursor_);
+  }
+  sort(paged.begin(), paged.end());
+  auto sorted_all = all;
+  sort(sorted_all.begin(), sorted_all.end());
+  REQUIRE(paged == sorted_all);
+
+  options = SyllableSegmentor::EnumerationOptions();
+  options.max_visited_nodes_ = 0;
+  page = s.GetSyllableList(options);
+  REQUIRE(page.syllable_lists_.empty());
+  REQUIRE(page.cursor_.has_value());
+
+  options = SyllableSegmentor::EnumerationOptions();
+  options.deadline_ = chrono::steady_clock::now();
+  page = s.GetSyllableList(options);
+  REQUIRE(page.syllable_lists_.empty());
+  REQUIRE(page.cursor_.has_value());
+  s.AppendPhone('g');
+  REQUIRE_THROWS_AS(s.GetSyllableList(options, &*page.cursor_),
+                    invalid_argument);
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "GetSyllableList reuses results across keystrokes", "[unit]")
+{
+  SyllableSegmentor typed(syllable_index_);
+  const string input = "xianxiangangfangan";
+  for (size_t i = 0; i < input.size(); ++i) {
+    typed.AppendPhone(input[i]);
+    if (i % 3 == 0) {
+      typed.AppendPhone('a');
+      typed.GetSyllableList();
+      typed.PopLastPhone();
+    }
+    SyllableSegmentor fresh(syllable_index_);
+    fresh.AppendPhones(input.substr(0, i + 1));
+    auto expected = fresh.GetSyllableList(
+        SyllableSegmentor::EnumerationOptions());
+    auto l = typed.GetSyllableList();
+    REQUIRE(l.size() == typed.CountSegmentations());
+    sort(l.begin(), l.end());
+    sort(expected.syllable_lists_.begin(), expected.syllable_lists_.end());
+    REQUIRE(l == expected.syllable_lists_);
+  }
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "GetSyllableList evicts cached prefixes it no longer needs",
+                 "[unit]")
+{
+  // Every "wo" keeps the 2048 segmentations of the "xian" run, so the
+  // prefixes cache more than kMaxCachedStrings strings in total.
+  string input;
+  for (int i = 0; i < 11; ++i) {
+    input += "xian";
+  }
+  for (int i = 0; i < 40; ++i) {
+    input += "wo";
+  }
+  SyllableSegmentor typed(syllable_index_);
+  auto check = [&typed] {
+    auto l = typed.GetSyllableList();
+    auto expected =
+        typed.GetSyllableList(SyllableSegmentor::EnumerationOptions())
+            .syllable_lists_;
+    sort(l.begin(), l.end());
+    sort(expected.begin(), expected.end());
+    REQUIRE(l == expected);
+  };
+  for (auto phone : input) {
+    typed.AppendPhone(phone);
+    typed.GetSyllableList();
+  }
+  check();
+  // Rendering after these needs evicted prefixes again.
+  for (int i = 0; i < 40; ++i) {
+    typed.PopLastPhone();
+  }
+  check();
+  typed.InsertPhone(4, 'g');
+  check();
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "GetSyllableIdList packs syllable ids", "[unit]")
+{
+  SyllableSegmentor s(syllable_index_);
+  REQUIRE(s.GetSyllableIdList().size() == 0);
+  s.AppendPhones("xiangang");
+  auto ids = s.GetSyllableIdList();
+  auto l = s.GetSyllableList();
+  REQUIRE(ids.size() == l.size());
+  REQUIRE(ids.offsets_.back() == ids.syllable_ids_.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    CHECK_THAT(l, VectorContains(s.Render(ids[i])));
+  }
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "CountSegmentations counts without enumerating", "[unit]")
+{
+  SyllableSegmentor s(syllable_index_);
+  REQUIRE(s.CountSegmentations() == 0);
+  for (auto c : "xiangang") {
+    s.AppendPhone(c);
+  }
+  REQUIRE(s.CountSegmentations() == s.GetSyllableList().size());
+  s.AppendPhone('v');
+  REQUIRE(s.CountSegmentations() == 0);
+
+  SyllableSegmentor ambiguous(syllable_index_);
+  for (auto i = 0; i < 100; ++i) {
+    for (auto c : string("xian")) {
+      ambiguous.AppendPhone(c);
+    }
+  }
+  REQUIRE(ambiguous.CountSegmentations() == UINT64_MAX);
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "TopK returns the cheapest segmentations first", "[unit]")
+{
+  REQUIRE(syllable_index_->GetCost(*syllable_index_->GetIndex("shi")) <
+          syllable_index_->GetCost(*syllable_index_->GetIndex("zei")));
+
+  SyllableSegmentor s(syllable_index_);
+  REQUIRE(s.TopK(9).empty());
+  for (auto c : "xiangang") {
+    s.AppendPhone(c);
+  }
+  auto all = s.TopK(100);
+  REQUIRE(all.size() == s.CountSegmentations());
+  for (size_t i = 1; i < all.size(); ++i) {
+    REQUIRE(all[i - 1].cost_ <= all[i].cost_);
+  }
+  auto top = s.TopK(2);
+  REQUIRE(top.size() == 2);
+  REQUIRE(s.Render(top[0].syllable_ids_) == s.Render(all[0].syllable_ids_));
+  REQUIRE(s.Render(top[0].syllable_ids_) == "xian`gang");
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "ReachesEnd tracks which positions can be completed", "[unit]")
+{
+  SyllableSegmentor s(syllable_index_);
+  REQUIRE(s.ReachesEnd(0));
+  for (auto c : "xiangan") {
+    s.AppendPhone(c);
+  }
+  REQUIRE(s.ReachesEnd(0));
+  REQUIRE(s.ReachesEnd(2));
+  REQUIRE_FALSE(s.ReachesEnd(1));
+  s.AppendPhone('v');
+  REQUIRE_FALSE(s.ReachesEnd(0));
+  REQUIRE(s.Segmentations().begin() == s.Segmentations().end());
+  s.PopLastPhone();
+  REQUIRE(s.ReachesEnd(0));
+  REQUIRE(s.GetSyllableList().size() == s.CountSegmentations());
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "AppendPhones appends a validated run of phones", "[unit]")
+{
+  const string input = "XianGangZhuangShuangFangan";
+  SyllableSegmentor bulk(syllable_index_);
+  SyllableSegmentor single(syllable_index_);
+  bulk.AppendPhones("xi");
+  bulk.AppendPhones(input.substr(2));
+  for (auto c : input) {
+    single.AppendPhone(c);
+  }
+  REQUIRE(bulk.size() == input.size());
+  REQUIRE(bulk.GetSyllableList() == single.GetSyllableList());
+
+  REQUIRE_THROWS_AS(bulk.AppendPhones("xiangangxiangang1"), invalid_argument);
+  REQUIRE_THROWS_AS(bulk.AppendPhones("xi\xe4n"), invalid_argument);
+  REQUIRE(bulk.size() == input.size());
+  REQUIRE(bulk.GetSyllableList() == single.GetSyllableList());
+  REQUIRE_NOTHROW(bulk.AppendPhones(""));
+
+  // Uppercase phones inserted one at a time are lowercased too.
+  SyllableSegmentor inserted(syllable_index_);
+  inserted.AppendPhones("ang");
+  inserted.InsertPhone(0, 'G');
+  CHECK_THAT(inserted.GetSyllableList(), VectorContains(string("gang")));
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "SegmentBatch returns results in input order", "[unit]")
+{
+  vector<string_view> inputs{"fangan", "xiangang", "", "zhuangv", "xianxian",
+                             "shi",    "fangan",   "a"};
+  SegmentBatchOptions options;
+  options.num_threads_ = 3;
+  auto results = SegmentBatch(syllable_index_, inputs, options);
+  REQUIRE(results.size() == inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    SyllableSegmentor s(syllable_index_);
+    for (auto c : inputs[i]) {
+      s.AppendPhone(c);
+    }
+    REQUIRE(results[i] == s.GetSyllableList());
+  }
+  REQUIRE(SegmentBatch(syllable_index_, {}).empty());
 }
 
 TEST_CASE_METHOD(SyllableSegmentorFixture, "can add, query, and delete phones",
@@ -93,4 +469,192 @@ TEST_CASE_METHOD(SyllableSegmentorFixture, "can add, query, and delete phones",
   CHECK_THAT(n, VectorContains(string("fang")));
 }
 
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "PopLastPhone restores the lattice of the shorter input",
+                 "[integration]")
+{
+  SyllableSegmentor typed(syllable_index_);
+  SyllableSegmentor expected(syllable_index_);
+  for (auto c : string("xianganzhuang")) {
+    typed.AppendPhone(c);
+  }
+  for (auto c : string("xiangan")) {
+    expected.AppendPhone(c);
+  }
+  for (auto i = 0; i < 6; ++i) {
+    typed.PopLastPhone();
+  }
+  REQUIRE(typed.size() == expected.size());
+  REQUIRE(typed.GetSyllableList() == expected.GetSyllableList());
+  typed.AppendPhone('g');
+  expected.AppendPhone('g');
+  REQUIRE(typed.GetSyllableList() == expected.GetSyllableList());
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "InsertPhone and ErasePhone repair the lattice in place",
+                 "[integration]")
+{
+  auto sorted_list = [](const SyllableSegmentor& s) {
+    auto l = s.GetSyllableList();
+    std::sort(l.begin(), l.end());
+    return l;
+  };
+  SyllableSegmentor edited(syllable_index_);
+  edited.AppendPhones("xiangzhuang");
+  edited.ErasePhone(4);
+  edited.InsertPhone(0, 'f');
+  edited.ErasePhone(1);
+  edited.InsertPhone(10, 'n');
+  edited.InsertPhone(5, 'a');
+
+  SyllableSegmentor expected(syllable_index_);
+  expected.AppendPhones("fianzahuangn");
+  REQUIRE(edited.size() == expected.size());
+  REQUIRE(sorted_list(edited) == sorted_list(expected));
+  REQUIRE(edited.CountSegmentations() == expected.CountSegmentations());
+
+  REQUIRE_THROWS_AS(edited.InsertPhone(edited.size() + 1, 'a'),
+                    std::out_of_range);
+  REQUIRE_THROWS_AS(edited.ErasePhone(edited.size()), std::out_of_range);
+
+  // Positions up to size() fit int16_t, so the longest input is one short.
+  SyllableSegmentor longest(syllable_index_);
+  longest.AppendPhones(string(INT16_MAX - 2, 'a'));
+  longest.InsertPhone(0, 'a');
+  REQUIRE(longest.size() == INT16_MAX - 1);
+  REQUIRE(longest.CountSegmentations() == 1);
+  REQUIRE_THROWS_AS(longest.InsertPhone(0, 'a'), std::length_error);
+  REQUIRE_THROWS_AS(longest.AppendPhone('a'), std::length_error);
+  REQUIRE_THROWS_AS(longest.AppendPhones("a"), std::length_error);
+  longest.ErasePhone(0);
+  REQUIRE(longest.CountSegmentations() == 1);
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "Separators are forced syllable boundaries", "[integration]")
+{
+  SyllableSegmentor s(syllable_index_);
+  s.AppendPhones("xi'an");
+  REQUIRE(s.GetSyllableList() == vector<string>{"xi`an"});
+  REQUIRE(s.CountSegmentations() == 1);
+  REQUIRE(s.GetSyllableIdList().size() == 1);
+  REQUIRE(s.GetSyllableIdList()[0].size() == 2);
+  REQUIRE(s.TopK(2).size() == 1);
+
+  SyllableSegmentor typed(syllable_index_);
+  for (auto c : string("xian`gang")) {
+    typed.AppendPhone(c);
+  }
+  auto l = typed.GetSyllableList();
+  CHECK_THAT(l, VectorContains(string("xian`gang")));
+  CHECK_THAT(l, VectorContains(string("xi`an`gang")));
+  CHECK_THAT(l, !VectorContains(string("xiang`ang")));
+  REQUIRE(typed.GetSyllableList(SyllableSegmentor::EnumerationOptions())
+              .syllable_lists_.size() == l.size());
+
+  typed.ErasePhone(4);
+  CHECK_THAT(typed.GetSyllableList(), VectorContains(string("xiang`ang")));
+  typed.InsertPhone(2, '\'');
+  CHECK_THAT(typed.GetSyllableList(), !VectorContains(string("xian`gang")));
+  CHECK_THAT(typed.GetSyllableList(), VectorContains(string("xi`an`gang")));
+
+  // Separators alone spell no syllable.
+  SyllableSegmentor separators(syllable_index_);
+  separators.AppendPhones("'`");
+  REQUIRE(separators.GetSyllableList().empty());
+  REQUIRE(separators.GetSyllableList(SyllableSegmentor::EnumerationOptions())
+              .syllable_lists_.empty());
+  REQUIRE(separators.CountSegmentations() == 0);
+  REQUIRE(separators.GetSyllableIdList().size() == 0);
+  REQUIRE(separators.TopK(1).empty());
+  separators.InsertPhone(1, 'a');
+  REQUIRE(separators.GetSyllableList() == vector<string>{"a"});
+  separators.ErasePhone(1);
+  REQUIRE(separators.CountSegmentations() == 0);
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "A partial last syllable is kept when enabled",
+                 "[integration]")
+{
+  SyllableSegmentor s(syllable_index_);
+  s.AppendPhones("xianzh");
+  REQUIRE(s.GetSyllableList().empty());
+  REQUIRE(s.CountSegmentations() == 0);
+
+  s.EnablePartialTail();
+  auto l = s.GetSyllableList();
+  CHECK_THAT(l, VectorContains(string("xian`zh*")));
+  CHECK_THAT(l, VectorContains(string("xi`an`zh*")));
+  REQUIRE(s.CountSegmentations() == l.size());
+  auto bounded =
+      s.GetSyllableList(SyllableSegmentor::EnumerationOptions()).syllable_lists_;
+  std::sort(l.begin(), l.end());
+  std::sort(bounded.begin(), bounded.end());
+  REQUIRE(bounded == l);
+  REQUIRE(s.TopK(1).front().syllable_ids_.back() ==
+          *syllable_index_->GetIndex("zhe"));
+  REQUIRE(s.TopK(1).front().partial_);
+  auto ids = s.GetSyllableIdList();
+  REQUIRE(ids.partial_ == vector<bool>(ids.size(), true));
+  for (auto iter = s.Segmentations().begin(); iter != s.Segmentations().end();
+       ++iter) {
+    REQUIRE(iter.partial_syllable() == "zh");
+  }
+
+  // The completion of a partial syllable is not the syllable typed.
+  SyllableSegmentor typed(syllable_index_);
+  typed.AppendPhones("xianzhe");
+  typed.EnablePartialTail();
+  auto typed_ids = typed.GetSyllableIdList();
+  REQUIRE(typed_ids.syllable_ids_ == ids.syllable_ids_);
+  REQUIRE(typed_ids.partial_ == vector<bool>(typed_ids.size(), false));
+  REQUIRE_FALSE(typed.TopK(1).front().partial_);
+
+  s.AppendPhone('i');
+  l = s.GetSyllableList();
+  CHECK_THAT(l, VectorContains(string("xian`zhi")));
+  CHECK_THAT(l, !VectorContains(string("xian`zh*")));
+  s.PopLastPhone();
+  CHECK_THAT(s.GetSyllableList(), VectorContains(string("xian`zh*")));
+
+  s.EnablePartialTail(false);
+  REQUIRE(s.GetSyllableList().empty());
+
+  // Runs of phones replace the partial last syllable like single phones.
+  SyllableSegmentor bulk(syllable_index_);
+  SyllableSegmentor single(syllable_index_);
+  bulk.EnablePartialTail();
+  single.EnablePartialTail();
+  bulk.AppendPhones("xianzh");
+  REQUIRE_THROWS_AS(bulk.AppendPhones("ang1"), invalid_argument);
+  CHECK_THAT(bulk.GetSyllableList(), VectorContains(string("xian`zh*")));
+  bulk.AppendPhones("angguo");
+  for (auto c : string("xianzhangguo")) {
+    single.AppendPhone(c);
+  }
+  REQUIRE(bulk.GetSyllableList() == single.GetSyllableList());
+  REQUIRE(bulk.CountSegmentations() == single.CountSegmentations());
+  bulk.AppendPhones("zh");
+  single.AppendPhones("z");
+  single.AppendPhone('h');
+  REQUIRE(bulk.GetSyllableList() == single.GetSyllableList());
+}
+
+TEST_CASE_METHOD(SyllableSegmentorFixture,
+                 "Stats stay zero unless enabled", "[unit]")
+{
+  REQUIRE(is_empty_v<StatsCounters<false>>);
+  REQUIRE(is_empty_v<StatsTotals<false>>);
+  {
+    SyllableSegmentor s(syllable_index_);
+    s.AppendPhones("xiangang");
+    REQUIRE_FALSE(s.GetSyllableList().empty());
+    REQUIRE(s.stats().index_probes_ == 0);
+    REQUIRE(s.stats().results_emitted_ == 0);
+  }
+  REQUIRE(syllable_index_->stats().edges_added_ == 0);
+}
+
 };  // namespace epinyin